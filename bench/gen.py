@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Writes generated wisp source for the benchmarks to standard output.
+
+Usage: python3 bench/gen.py KIND MB > out.wisp
+
+  quoted   lines of Q-Expression data: numbers, symbols, escaped
+           strings, nested lists and comments, for the reader
+  defs     `def` lines of 200 numbers each, for bench/mpc_file.c
+  script   a program of function and value definitions, for timing
+           `load` with and without its .wispc cache
+"""
+import random
+import sys
+
+
+def quoted(size):
+    random.seed(7)
+    out = []
+    n = 0
+    while n < size:
+        items = []
+        for _ in range(random.randint(5, 20)):
+            r = random.random()
+            if r < 0.4:
+                items.append(str(random.randint(-100000, 100000)))
+            elif r < 0.7:
+                items.append(random.choice(['foo', 'bar-baz', '+', '<=', 'lambda', 'x1', 'head']))
+            elif r < 0.85:
+                items.append('"str %d \\"q\\""' % random.randint(0, 999))
+            else:
+                items.append('{%d (%s %d)}' % (random.randint(0, 9), random.choice(['a', 'b']), random.randint(0, 9)))
+        line = '{' + ' '.join(items) + '} ; comment\n'
+        out.append(line)
+        n += len(line)
+    return out
+
+
+def defs(size):
+    random.seed(1)
+    out = []
+    n = 0
+    while n < size:
+        line = '(def {d%d} {%s})\n' % (len(out), ' '.join(str(random.randint(0, 99999)) for _ in range(200)))
+        out.append(line)
+        n += len(line)
+    return out
+
+
+def script(size):
+    random.seed(5)
+    out = ['(def {fun} (\\ {f b} {def (head f) (\\ (tail f) b)}))\n']
+    n = 0
+    i = 0
+    while n < size:
+        k = i % 4
+        if k == 0:
+            line = '(fun {h%d x y} {if (> x y) {+ x %d} {- y %d}})\n' % (i, i, i)
+        elif k == 1:
+            line = '(def {d%d} {%s})\n' % (i, ' '.join(str(random.randint(0, 99999)) for _ in range(40)))
+        elif k == 2:
+            line = '(fun {g%d l} {map (\\ {x} {* x %d}) l}) ; helper %d\n' % (i, i, i)
+        else:
+            line = '(def {s%d} "helper string number %d")\n' % (i, i)
+        out.append(line)
+        n += len(line)
+        i += 1
+    return out
+
+
+KINDS = {'quoted': quoted, 'defs': defs, 'script': script}
+
+if len(sys.argv) != 3 or sys.argv[1] not in KINDS:
+    sys.exit(__doc__)
+sys.stdout.write(''.join(KINDS[sys.argv[1]](int(float(sys.argv[2]) * 1000000))))
@@ -0,0 +1,82 @@
+/*
+ * Times mpc parsing a wisp-like grammar from a string, a file or a pipe,
+ * building no AST, to compare mpc's three kinds of input.
+ *
+ * Build: cc -std=c11 -O2 bench/mpc_file.c mpc.c -lm -o mpc_file
+ * Usage: ./mpc_file s data.wisp    whole file read into a string first
+ *        ./mpc_file f data.wisp    mpc_parse_file
+ *        ./mpc_file p < data.wisp  mpc_parse_pipe on standard input
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../mpc.h"
+
+int main(int argc, char** argv)
+{
+	if (argc < 2 || strchr("sfp", argv[1][0]) == NULL || (argv[1][0] != 'p' && argc < 3))
+	{
+		fprintf(stderr, "Usage: mpc_file s|f FILE, or mpc_file p < FILE\n");
+		return 1;
+	}
+	char* name = argc > 2 ? argv[2] : "<stdin>";
+
+	mpc_parser_t* Expr = mpc_new("expr");
+	mpc_parser_t* Top = mpc_new("top");
+	mpc_define(Expr, mpc_or(5,
+		mpc_apply(mpc_tok(mpc_re("-?[0-9]+")), mpcf_free),
+		mpc_apply(mpc_tok(mpc_re("[a-zA-Z_+\\-*/=<>!&]+")), mpcf_free),
+		mpc_apply(mpc_tok(mpc_re(";[^\\r\\n]*")), mpcf_free),
+		mpc_and(3, mpcf_all_free, mpc_tok(mpc_char('(')),
+			mpc_many(mpcf_all_free, Expr), mpc_tok(mpc_char(')')), free, free),
+		mpc_and(3, mpcf_all_free, mpc_tok(mpc_char('{')),
+			mpc_many(mpcf_all_free, Expr), mpc_tok(mpc_char('}')), free, free)));
+	mpc_define(Top, mpc_and(3, mpcf_all_free, mpc_tok(mpc_re("^")),
+		mpc_many(mpcf_all_free, Expr), mpc_tok(mpc_re("$")), free, free));
+
+	mpc_result_t r;
+	int ok = 0;
+	clock_t start = clock();
+
+	if (argv[1][0] == 'p') {
+		ok = mpc_parse_pipe(name, stdin, Top, &r);
+	}
+	else
+	{
+		FILE* f = fopen(name, "rb");
+		if (!f)
+		{
+			fprintf(stderr, "Could not open %s\n", name);
+			mpc_cleanup(2, Expr, Top);
+			return 1;
+		}
+
+		if (argv[1][0] == 'f') {
+			ok = mpc_parse_file(name, f, Top, &r);
+		}
+		else
+		{
+			fseek(f, 0, SEEK_END);
+			long n = ftell(f);
+			fseek(f, 0, SEEK_SET);
+			char* s = malloc(n + 1);
+			s[fread(s, 1, n, f)] = '\0';
+			ok = mpc_parse(name, s, Top, &r);
+			free(s);
+		}
+		fclose(f);
+	}
+
+	fprintf(stderr, "cpu %.3f s\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+	if (ok) {
+		puts("ok");
+	} else {
+		mpc_err_print(r.error);
+		mpc_err_delete(r.error);
+	}
+
+	mpc_cleanup(2, Expr, Top);
+	return ok ? 0 : 1;
+}
@@ -35,21 +35,18 @@ static mpc_state_t mpc_state_new(void) {
 ** The cursor can jump around at will making
 ** backtracking easy.
 **
-** The second is a File which is also somewhat
-** easy. The contents are never loaded into
-** memory but backtracking can still be achieved
-** by seeking in the file at different positions.
+** File and Pipe are read the same way, a chunk
+** at a time, into a buffer that holds the input
+** from the earliest mark onward. Backtracking
+** moves the cursor back inside this buffer, so
+** files are never seeked while parsing and pipes
+** need no lookahead beyond what is buffered.
+** Input before the first mark is dropped as new
+** chunks are read.
 **
-** The final mode is Pipe. This is the difficult
-** one. As we assume pipes cannot be seeked - and
-** only support a single character lookahead at
-** any point, when the input is marked for a
-** potential backtracking we start buffering any
-** input.
-**
-** This means that if we are requested to seek
-** back we can simply start reading from the
-** buffer instead of the input.
+** Once parsing ends a File is seeked back to
+** just after the parsed input. A Pipe cannot be,
+** so any input read ahead of that point is lost.
 **
 ** Of course using `mpc_predictive` will disable
 ** backtracking and make LL(1) grammars easy
@@ -71,6 +68,10 @@ enum {
   MPC_INPUT_MEM_NUM = 512
 };
 
+enum {
+  MPC_INPUT_CHUNK = 65536
+};
+
 typedef struct {
   char mem[64];
 } mpc_mem_t;
@@ -83,7 +84,12 @@ typedef struct {
 
   char *string;
   char *buffer;
+  long buffer_pos;
+  size_t buffer_len;
+  size_t buffer_slots;
+  int buffer_end;
   FILE *file;
+  long file_base;
 
   int suppress;
   int backtrack;
@@ -113,7 +119,12 @@ static mpc_input_t *mpc_input_new_string(const char *filename, const char *strin
   i->string = malloc(strlen(string) + 1);
   strcpy(i->string, string);
   i->buffer = NULL;
+  i->buffer_pos = 0;
+  i->buffer_len = 0;
+  i->buffer_slots = 0;
+  i->buffer_end = 0;
   i->file = NULL;
+  i->file_base = 0;
 
   i->suppress = 0;
   i->backtrack = 1;
@@ -143,7 +154,12 @@ static mpc_input_t *mpc_input_new_nstring(const char *filename, const char *stri
   strncpy(i->string, string, length);
   i->string[length] = '\0';
   i->buffer = NULL;
+  i->buffer_pos = 0;
+  i->buffer_len = 0;
+  i->buffer_slots = 0;
+  i->buffer_end = 0;
   i->file = NULL;
+  i->file_base = 0;
 
   i->suppress = 0;
   i->backtrack = 1;
@@ -171,8 +187,13 @@ static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
   i->state = mpc_state_new();
 
   i->string = NULL;
-  i->buffer = NULL;
+  i->buffer = malloc(MPC_INPUT_CHUNK);
+  i->buffer_pos = 0;
+  i->buffer_len = 0;
+  i->buffer_slots = MPC_INPUT_CHUNK;
+  i->buffer_end = 0;
   i->file = pipe;
+  i->file_base = 0;
 
   i->suppress = 0;
   i->backtrack = 1;
@@ -199,8 +220,14 @@ static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
   i->state = mpc_state_new();
 
   i->string = NULL;
-  i->buffer = NULL;
+  i->buffer = malloc(MPC_INPUT_CHUNK);
+  i->buffer_pos = 0;
+  i->buffer_len = 0;
+  i->buffer_slots = MPC_INPUT_CHUNK;
+  i->buffer_end = 0;
   i->file = file;
+  i->file_base = ftell(file);
+  if (i->file_base < 0) { i->file_base = 0; }
 
   i->suppress = 0;
   i->backtrack = 1;
@@ -221,7 +248,8 @@ static void mpc_input_delete(mpc_input_t *i) {
   free(i->filename);
 
   if (i->type == MPC_INPUT_STRING) { free(i->string); }
-  if (i->type == MPC_INPUT_PIPE) { free(i->buffer); }
+  if (i->type == MPC_INPUT_FILE) { fseek(i->file, i->file_base + i->state.pos, SEEK_SET); }
+  free(i->buffer);
 
   free(i->marks);
   free(i->lasts);
@@ -313,14 +341,9 @@ static void mpc_input_mark(mpc_input_t *i) {
   i->marks[i->marks_num-1] = i->state;
   i->lasts[i->marks_num-1] = i->last;
 
-  if (i->type == MPC_INPUT_PIPE && i->marks_num == 1) {
-    i->buffer = calloc(1, 1);
-  }
-
 }
 
 static void mpc_input_unmark(mpc_input_t *i) {
-  int j;
 
   if (i->backtrack < 1) { return; }
 
@@ -335,14 +358,6 @@ static void mpc_input_unmark(mpc_input_t *i) {
     i->lasts = realloc(i->lasts, sizeof(char) * i->marks_slots);
   }
 
-  if (i->type == MPC_INPUT_PIPE && i->marks_num == 0) {
-    for (j = strlen(i->buffer) - 1; j >= 0; j--)
-      ungetc(i->buffer[j], i->file);
-
-    free(i->buffer);
-    i->buffer = NULL;
-  }
-
 }
 
 static void mpc_input_rewind(mpc_input_t *i) {
@@ -352,80 +367,78 @@ static void mpc_input_rewind(mpc_input_t *i) {
   i->state = i->marks[i->marks_num-1];
   i->last  = i->lasts[i->marks_num-1];
 
-  if (i->type == MPC_INPUT_FILE) {
-    fseek(i->file, i->state.pos, SEEK_SET);
-  }
-
   mpc_input_unmark(i);
 }
 
-static int mpc_input_buffer_in_range(mpc_input_t *i) {
-  return i->state.pos < (long)(strlen(i->buffer) + i->marks[0].pos);
-}
+/* Reads chunks until the cursor is inside the buffer or the input ends */
+static int mpc_input_buffer_fill(mpc_input_t *i) {
 
-static char mpc_input_buffer_get(mpc_input_t *i) {
-  return i->buffer[i->state.pos - i->marks[0].pos];
-}
+  long keep;
+  size_t drop, n;
+  int c;
 
-static char mpc_input_getc(mpc_input_t *i) {
+  while (i->state.pos >= i->buffer_pos + (long)i->buffer_len) {
 
-  char c = '\0';
+    if (i->buffer_end) { return 0; }
 
-  switch (i->type) {
-
-    case MPC_INPUT_STRING: return i->string[i->state.pos];
-    case MPC_INPUT_FILE: c = fgetc(i->file); return c;
-    case MPC_INPUT_PIPE:
+    /*
+    ** Nothing before the earliest mark can be rewound
+    ** to. It is only dropped once it outweighs what is
+    ** kept, so each byte is moved a bounded number of
+    ** times.
+    */
+    keep = i->marks_num > 0 ? i->marks[0].pos : i->state.pos;
+    if (keep > i->buffer_pos + (long)i->buffer_len) {
+      keep = i->buffer_pos + (long)i->buffer_len;
+    }
+    drop = keep - i->buffer_pos;
+    if (drop > 0 && drop >= i->buffer_len - drop) {
+      i->buffer_len -= drop;
+      memmove(i->buffer, i->buffer + drop, i->buffer_len);
+      i->buffer_pos = keep;
+    }
 
-      if (!i->buffer) { c = getc(i->file); return c; }
+    if (i->buffer_slots - i->buffer_len < MPC_INPUT_CHUNK) {
+      i->buffer_slots *= 2;
+      i->buffer = realloc(i->buffer, i->buffer_slots);
+    }
 
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
-        c = mpc_input_buffer_get(i);
-        return c;
-      } else {
+    /* Pipes are read a line at a time so interactive input is not held up */
+    if (i->type == MPC_INPUT_FILE) {
+      n = fread(i->buffer + i->buffer_len, 1, MPC_INPUT_CHUNK, i->file);
+      if (n < MPC_INPUT_CHUNK) { i->buffer_end = 1; }
+    } else {
+      n = 0;
+      while (n < MPC_INPUT_CHUNK) {
         c = getc(i->file);
-        return c;
+        if (c == EOF) { i->buffer_end = 1; break; }
+        i->buffer[i->buffer_len + n++] = c;
+        if (c == '\n') { break; }
       }
-
-    default: return c;
+    }
+    i->buffer_len += n;
   }
-}
 
-static char mpc_input_peekc(mpc_input_t *i) {
+  return 1;
+}
 
-  char c = '\0';
+static char mpc_input_getc(mpc_input_t *i) {
 
   switch (i->type) {
+
     case MPC_INPUT_STRING: return i->string[i->state.pos];
     case MPC_INPUT_FILE:
-
-      c = fgetc(i->file);
-      if (feof(i->file)) { return '\0'; }
-
-      fseek(i->file, -1, SEEK_CUR);
-      return c;
-
     case MPC_INPUT_PIPE:
 
-      if (!i->buffer) {
-        c = getc(i->file);
-        if (feof(i->file)) { return '\0'; }
-        ungetc(c, i->file);
-        return c;
-      }
-
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
-        return mpc_input_buffer_get(i);
-      } else {
-        c = getc(i->file);
-        if (feof(i->file)) { return '\0'; }
-        ungetc(c, i->file);
-        return c;
-      }
+      if (!mpc_input_buffer_fill(i)) { return '\0'; }
+      return i->buffer[i->state.pos - i->buffer_pos];
 
-    default: return c;
+    default: return '\0';
   }
+}
 
+static char mpc_input_peekc(mpc_input_t *i) {
+  return mpc_input_getc(i);
 }
 
 static int mpc_input_terminated(mpc_input_t *i) {
@@ -433,34 +446,12 @@ static int mpc_input_terminated(mpc_input_t *i) {
 }
 
 static int mpc_input_failure(mpc_input_t *i, char c) {
-
-  switch (i->type) {
-    case MPC_INPUT_STRING: { break; }
-    case MPC_INPUT_FILE: fseek(i->file, -1, SEEK_CUR); { break; }
-    case MPC_INPUT_PIPE: {
-
-      if (!i->buffer) { ungetc(c, i->file); break; }
-
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
-        break;
-      } else {
-        ungetc(c, i->file);
-      }
-    }
-    default: { break; }
-  }
+  (void)i; (void)c;
   return 0;
 }
 
 static int mpc_input_success(mpc_input_t *i, char c, char **o) {
 
-  if (i->type == MPC_INPUT_PIPE
-  &&  i->buffer && !mpc_input_buffer_in_range(i)) {
-    i->buffer = realloc(i->buffer, strlen(i->buffer) + 2);
-    i->buffer[strlen(i->buffer) + 1] = '\0';
-    i->buffer[strlen(i->buffer) + 0] = c;
-  }
-
   i->last = c;
   i->state.pos++;
   i->state.col++;
@@ -0,0 +1,15 @@
+#!/bin/sh
+# Checks that closure cycles through compiled code are reclaimed.
+# Usage: tests/gc_cycle.sh [path to wisp]
+WISP=${1:-./wisp}
+DIR=$(dirname "$0")
+
+out=$("$WISP" "$DIR/gc_cycle.wisp") || { echo "gc_cycle: wisp failed"; exit 1; }
+reclaimed=$(echo "$out" | awk '/^reclaimed:/ { print $2; exit }')
+live=$(echo "$out" | awk '/^live bytes:/ { print $3; exit }')
+
+if [ -z "$reclaimed" ] || [ "$reclaimed" -lt 200000 ] || [ "$live" -gt 8388608 ]; then
+	echo "gc_cycle: FAIL (reclaimed $reclaimed, live bytes $live)"
+	exit 1
+fi
+echo "gc_cycle: ok (reclaimed $reclaimed, live bytes $live)"
@@ -1,9 +1,19 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stddef.h>
+#include <time.h>
 #include "mpc.h"
 
 #ifdef _WIN32
 #include <string.h>
+#include <process.h>
+#define getpid _getpid
 
 static char buffer[2048];
 
@@ -22,6 +32,10 @@ void add_history(char* unused)
 
 #else
 #include <editline/readline.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 /* Parser declarations */
@@ -35,905 +49,3873 @@ mpc_parser_t* Qexpr;
 mpc_parser_t* Expr;
 mpc_parser_t* Wispy;
 
+mpc_parser_t* wgrammar(void);
+
 /* Forward declarations */
 
 struct wval;
 struct wenv;
+struct wcode;
 typedef struct wval wval;
 typedef struct wenv wenv;
+typedef struct wcode wcode;
 
-/* Wisp Value */
-
-enum { WVAL_ERR, WVAL_NUM,   WVAL_SYM, WVAL_STR, 
-       WVAL_FUN, WVAL_SEXPR, WVAL_QEXPR };
-
-typedef wval*(*wbuiltin)(wenv*, wval*);
+/* Symbol Interning */
 
-struct wval 
+/* Every symbol name is stored once, so the canonical pointer doubles as its ID */
+struct
 {
-	int type;
-	
-	/* Basic */
-	long num;
-	char* err;
-	char* sym;
-	char* str;
-
-	/* Function */
-	wbuiltin builtin;
-	wenv* env;
-	wval* formals;
-	wval* body;
-
-	/* Expression */
 	int count;
-	wval** cell;
-};
+	int cap;
+	char** names;
+} wsyms;
 
-wval* wval_err(char* fmt, ...)
+/* Each name is preceded by a count of the local frames binding it */
+typedef struct
 {
-	wval* v = malloc(sizeof(wval));
-	v->type = WVAL_ERR;
-
-	va_list va;
-	va_start(va, fmt);
-
-	v->err = malloc(512);
-	vsnprintf(v->err, 511, fmt, va);
+	int locals;
+	char name[];
+} wsym;
 
-	v->err = realloc(v->err, strlen(v->err)+1);
+#define WSYM(s) ((wsym*)((s) - offsetof(wsym, name)))
 
-	va_end(va);
-	return v;
+unsigned long whash_str(char* s)
+{
+	unsigned long h = 2166136261UL;
+	while (*s) { h = (h ^ (unsigned char)*s++) * 16777619UL; }
+	return h;
 }
 
-wval* wval_num(long x)
+/* Hashes n bytes at s the way whash_str hashes a whole string */
+unsigned long whash_mem(char* s, size_t n)
 {
-	wval* v = malloc(sizeof(wval));
-	v->type = WVAL_NUM;
-	v->num = x;
-	return v;
+	unsigned long h = 2166136261UL;
+	while (n--) { h = (h ^ (unsigned char)*s++) * 16777619UL; }
+	return h;
 }
 
-wval* wval_sym(char* s)
+unsigned long whash_ptr(void* p)
 {
-	wval* v = malloc(sizeof(wval));
-	v->type = WVAL_SYM;
-	v->sym = malloc(strlen(s) + 1);
-	strcpy(v->sym, s);
-	return v;
+	uintptr_t x = (uintptr_t)p;
+	x ^= x >> 16;
+	return (unsigned long)(x * 2654435761UL);
 }
 
-wval* wval_str(char *s)
+void wsym_grow(void)
 {
-	wval* v = malloc(sizeof(wval));
-	v->type = WVAL_STR;
-	v->str = malloc(strlen(s) + 1);
-	strcpy(v->str, s);
-	return v;
+	int cap = wsyms.cap ? wsyms.cap * 2 : 256;
+	char** names = calloc(cap, sizeof(char*));
+	for (int i = 0; i < wsyms.cap; i++)
+	{
+		if (!wsyms.names[i]) { continue; }
+		unsigned long j = whash_str(wsyms.names[i]) & (cap-1);
+		while (names[j]) { j = (j+1) & (cap-1); }
+		names[j] = wsyms.names[i];
+	}
+	free(wsyms.names);
+	wsyms.names = names;
+	wsyms.cap = cap;
 }
 
-wval* wval_builtin(wbuiltin func)
+/* Interns the n bytes at s, which need not end the string */
+char* wsym_intern_n(char* s, size_t n)
 {
-	wval* v = malloc(sizeof(wval));
-	v->type = WVAL_FUN;
-	v->builtin = func;
-	return v;
+	if ((wsyms.count+1) * 4 > wsyms.cap * 3) { wsym_grow(); }
+
+	unsigned long i = whash_mem(s, n) & (wsyms.cap-1);
+	while (wsyms.names[i])
+	{
+		char* name = wsyms.names[i];
+		if (strncmp(name, s, n) == 0 && name[n] == '\0') { return name; }
+		i = (i+1) & (wsyms.cap-1);
+	}
+
+	wsym* sym = malloc(sizeof(wsym) + n + 1);
+	sym->locals = 0;
+	memcpy(sym->name, s, n);
+	sym->name[n] = '\0';
+	wsyms.names[i] = sym->name;
+	wsyms.count++;
+	return wsyms.names[i];
 }
 
-wval* wval_sexpr(void)
+char* wsym_intern(char* s)
 {
-	wval* v = malloc(sizeof(wval));
-	v->type = WVAL_SEXPR;
-	v->count = 0;
-	v->cell = NULL;
-	return v;
+	return wsym_intern_n(s, strlen(s));
 }
 
-wval* wval_qexpr(void)
+/* Symbols the evaluator compares against directly */
+char* wsym_amp;
+char* wsym_if;
+
+void wsym_init(void)
 {
-	wval* v = malloc(sizeof(wval));
-	v->type = WVAL_QEXPR;
-	v->count = 0;
-	v->cell = NULL;
-	return v;
+	wsym_amp = wsym_intern("&");
+	wsym_if = wsym_intern("if");
 }
 
-wenv* wenv_new(void);
-
-wval* wval_lambda(wval* formals, wval* body)
+void wsym_cleanup(void)
 {
-	wval* v = malloc(sizeof(wval));
-	v->type = WVAL_FUN;
-	v->builtin = NULL;
-	v->env = wenv_new();
-	v->formals = formals;
-	v->body = body;
-	return v;
+	for (int i = 0; i < wsyms.cap; i++) {
+		if (wsyms.names[i]) { free(WSYM(wsyms.names[i])); }
+	}
+	free(wsyms.names);
+	wsyms.names = NULL;
+	wsyms.count = wsyms.cap = 0;
 }
 
-void wenv_del(wenv* e);
+/* Managed Heap */
 
-void wval_del(wval* v)
+/* Link for heap objects that can take part in a reference cycle */
+typedef struct wgc
 {
-	switch (v->type)
-	{
-		case WVAL_NUM: break;
-		case WVAL_FUN: 
-			if (!v->builtin) 
-			{
-				wenv_del(v->env);
-				wval_del(v->formals);
-				wval_del(v->body);
-			}
-			break;
-		case WVAL_ERR: free(v->err); break;
-		case WVAL_SYM: free(v->sym); break;
-		case WVAL_STR: free(v->str); break;
-		case WVAL_QEXPR:
-		case WVAL_SEXPR:
-			for (int i = 0; i < v->count; i++) {
-				wval_del(v->cell[i]);
-			}
-			free(v->cell);
-			break;
-	}
-	free(v);
+	struct wgc* prev;
+	struct wgc* next;
+	int kind;
+	int gen;
+	int refs;
+	int gc_refs;
+	int marked;
+} wgc;
+
+enum { WGC_CELLS, WGC_ENV, WGC_CODE };
+
+#ifndef WGC_MIN_HEAP
+#define WGC_MIN_HEAP (1 << 20)
+#endif
+
+/* Containers start out young and are promoted to old by surviving a collection */
+struct
+{
+	wgc young;
+	wgc old;
+	size_t live;
+	size_t threshold;
+	int growth;
+	long collections;
+	long minors;
+	long reclaimed;
+	double pause_total;
+	double pause_max;
+} wheap;
+
+void wheap_init(void)
+{
+	wheap.young.prev = wheap.young.next = &wheap.young;
+	wheap.old.prev = wheap.old.next = &wheap.old;
+	wheap.threshold = WGC_MIN_HEAP;
+	wheap.growth = 200;
+
+	char* growth = getenv("WISP_GC_GROWTH");
+	if (growth && atoi(growth) > 100) { wheap.growth = atoi(growth); }
 }
 
-wenv* wenv_copy(wenv* e);
+/* Slab Allocator */
 
-wval* wval_copy(wval* v)
+/*
+ * Small heap objects (envs, frames, cell arrays, strings) come from free
+ * lists kept per 16 byte size class, refilled by carving up a page at a
+ * time. Every caller passes the size back when freeing, so objects need
+ * no header. Build with WISP_NO_SLAB to use plain malloc for everything,
+ * values included, so ASan can see each object.
+ */
+
+#ifndef WSLAB_PAGE
+#define WSLAB_PAGE 4096
+#endif
+
+#define WSLAB_GRAIN 16
+#define WSLAB_MAX 256
+#define WSLAB_CLASS(n) ((n) ? ((n) - 1) / WSLAB_GRAIN : 0)
+
+struct
 {
-	wval* x = malloc(sizeof(wval));
-	x->type = v->type;
+	void* free[WSLAB_MAX / WSLAB_GRAIN];
+	void* pages;
+	long npages;
+} wslab;
 
-	switch (v->type)
+#ifndef WISP_NO_SLAB
+
+void* wslab_alloc(size_t n)
+{
+	int k = WSLAB_CLASS(n);
+	if (!wslab.free[k])
 	{
-		case WVAL_FUN: 
-			if (v->builtin) {
-				x->builtin = v->builtin;
-			} else {
-				x->builtin = NULL;
-				x->env = wenv_copy(v->env);
-				x->formals = wval_copy(v->formals);
-				x->body = wval_copy(v->body);
-			}
-			break;
-		case WVAL_NUM: x->num = v->num; break;
-		case WVAL_ERR:
-			x->err = malloc(strlen(v->err) + 1);
-			strcpy(x->err, v->err); break;
-		case WVAL_SYM:
-			x->sym = malloc(strlen(v->sym) + 1);
-			strcpy(x->sym, v->sym); break;
-		case WVAL_STR:
-			x->str = malloc(strlen(v->str) +1);
-			strcpy(x->str, v->str); break;
-		case WVAL_SEXPR:
-		case WVAL_QEXPR:
-			x->count = v->count;
-			x->cell = malloc(sizeof(wval*) * x->count);
-			for (int i = 0; i < x->count; i++) {
-				x->cell[i] = wval_copy(v->cell[i]);
-			}
-			break;
+		/* The first slot links the page for cleanup */
+		char* page = malloc(WSLAB_PAGE);
+		*(void**)page = wslab.pages;
+		wslab.pages = page;
+		wslab.npages++;
+
+		size_t size = (k+1) * WSLAB_GRAIN;
+		for (size_t i = WSLAB_GRAIN; i + size <= WSLAB_PAGE; i += size)
+		{
+			*(void**)(page + i) = wslab.free[k];
+			wslab.free[k] = page + i;
+		}
 	}
-	return x;
+
+	void* p = wslab.free[k];
+	wslab.free[k] = *(void**)p;
+	return p;
 }
 
-wval* wval_add(wval* v, wval* x)
+void wslab_free(void* p, size_t n)
 {
-	v->count++;
-	v->cell = realloc(v->cell, sizeof(wval*) * v->count);
-	v->cell[v->count-1] = x;
-	return v;
+	int k = WSLAB_CLASS(n);
+	*(void**)p = wslab.free[k];
+	wslab.free[k] = p;
 }
 
-wval* wval_pop(wval* v, int i)
+#endif
+
+void wslab_cleanup(void)
 {
-	wval* x = v->cell[i];
-	memmove(&v->cell[i], 
-		&v->cell[i+1],
-		sizeof(wval*) * (v->count-i-1));
-	v->count--;
-	v->cell = realloc(v->cell, sizeof(wval*) * v->count);
-	return x;
+	while (wslab.pages)
+	{
+		void* page = wslab.pages;
+		wslab.pages = *(void**)page;
+		free(page);
+	}
+	memset(&wslab, 0, sizeof(wslab));
 }
 
-wval* wval_take(wval* v, int i)
+void* wheap_alloc(size_t n)
 {
-	wval* x = wval_pop(v, i);
-	wval_del(v);
-	return x;
+	wheap.live += n;
+#ifndef WISP_NO_SLAB
+	if (n <= WSLAB_MAX) { return wslab_alloc(n); }
+#endif
+	return malloc(n);
 }
 
-wval* wval_join(wval* x, wval* y)
+void* wheap_calloc(size_t n, size_t size)
 {
-	while (y->count) {
-		x = wval_add(x, wval_pop(y, 0));
-	}
-
-	wval_del(y);
-	return x;
+	void* p = wheap_alloc(n * size);
+	memset(p, 0, n * size);
+	return p;
 }
 
-int wval_eq(wval* x, wval* y)
+void wheap_free(void* p, size_t n)
 {
-	if (x->type != y->type) { return 0; }
-
-	switch (x->type)
+	if (!p) { return; }
+	wheap.live -= n;
+#ifndef WISP_NO_SLAB
+	if (n <= WSLAB_MAX)
 	{
-		case WVAL_NUM: return (x->num == y->num);
-		case WVAL_ERR: return (strcmp(x->err, y->err) == 0);
-		case WVAL_SYM: return (strcmp(x->sym, y->sym) == 0);
-		case WVAL_STR: return (strcmp(x->str, y->str) == 0);
-		case WVAL_FUN:
-			if (x->builtin || y->builtin) {
-				return x->builtin == y->builtin;
-			} else {
-				return wval_eq(x->formals, y->formals)
-				    && wval_eq(x->body, y->body);
-			}
-		case WVAL_QEXPR:
-		case WVAL_SEXPR:
-			if (x->count != y->count) { return 0; }
-			for (int i = 0; i < x->count; i++) {
-				if (!wval_eq(x->cell[i], y->cell[i])) { return 0; }
-			}
-			return 1;
-		break;
+		wslab_free(p, n);
+		return;
 	}
-	return 0;
-}
-
-void wval_print_str(wval* v)
-{
-	char* escaped = malloc(strlen(v->str) + 1);
-	strcpy(escaped, v->str);
-	escaped = mpcf_escape(escaped);
-	printf("\"%s\"", escaped);
-	free(escaped);
+#endif
+	free(p);
 }
 
-void wval_print(wval* v);
-void wval_expr_print(wval* v, char open, char close)
+void* wheap_realloc(void* p, size_t from, size_t to)
 {
-	putchar(open);
-	for (int i = 0; i < v->count; i++)
+#ifndef WISP_NO_SLAB
+	if (from <= WSLAB_MAX || to <= WSLAB_MAX)
 	{
-		wval_print(v->cell[i]);
-		if (i != (v->count-1)) { 
-			putchar(' '); 
+		if (p && WSLAB_CLASS(from) == WSLAB_CLASS(to) && to <= WSLAB_MAX)
+		{
+			wheap.live += to - from;
+			return p;
+		}
+
+		void* x = wheap_alloc(to);
+		if (p)
+		{
+			memcpy(x, p, from < to ? from : to);
+			wheap_free(p, from);
 		}
+		return x;
 	}
-	putchar(close);
+#endif
+	wheap.live += to - from;
+	return realloc(p, to);
 }
 
-void wval_print(wval* v)
+void wheap_track(wgc* g, int kind)
 {
-	switch (v->type)
-	{
-		case WVAL_NUM:   printf("%li", v->num); break;
-		case WVAL_ERR:   printf("Error: %s", v->err); break;
-		case WVAL_SYM:	 printf("%s", v->sym); break;
-		case WVAL_STR:   wval_print_str(v); break;
-		case WVAL_SEXPR: wval_expr_print(v, '(', ')'); break;
-		case WVAL_QEXPR: wval_expr_print(v, '{', '}'); break;
-		case WVAL_FUN:
-			if (v->builtin) {
-				printf("<builtin>");
-			} else {
-				printf("(\\ "); wval_print(v->formals);
-				putchar(' '); wval_print(v->body); putchar(')');
-			}
-			break;
-	}
+	g->kind = kind;
+	g->gen = 0;
+	g->refs = 1;
+	g->marked = 0;
+	g->prev = &wheap.young;
+	g->next = wheap.young.next;
+	g->next->prev = g;
+	wheap.young.next = g;
 }
 
-void wval_println(wval* v)
+/* Fixes up the neighbours' links after realloc has moved an object */
+void wheap_moved(wgc* g)
 {
-	printf("    <~  ");
-	wval_print(v);
-	putchar('\n');
+	g->prev->next = g;
+	g->next->prev = g;
 }
 
-char* wtype_name(int t)
+void wheap_untrack(wgc* g)
 {
-	switch(t)
-	{
-		case WVAL_FUN:   return "Function";
-		case WVAL_NUM:   return "Number";
-		case WVAL_ERR:   return "Error";
-		case WVAL_SYM:   return "Symbol";
-		case WVAL_STR:   return "String";
-		case WVAL_SEXPR: return "S-Expression";
-		case WVAL_QEXPR: return "Q-Expression";
-		default:         return "Unknown";
-	}
+	g->prev->next = g->next;
+	g->next->prev = g->prev;
 }
 
-/* Wisp Environment */
+/* Wisp Value */
 
-struct wenv
+enum { WVAL_ERR, WVAL_NUM,   WVAL_SYM, WVAL_STR, 
+       WVAL_FUN, WVAL_SEXPR, WVAL_QEXPR };
+
+typedef wval*(*wbuiltin)(wenv*, wval*);
+
+struct wval 
 {
-	wenv* par;
+	int type;
+
+	/* Expression */
 	int count;
-	char** syms;
-	wval** vals;
+
+	union
+	{
+		/* Basic */
+		long num;
+		char* err;
+		char* str;
+
+		/* Function */
+		struct
+		{
+			wbuiltin builtin;
+			wenv* env;
+			wval* formals;
+			wval* body;
+			wcode* code;
+
+			/* Arguments of a partial application, bound once all are given */
+			wval* args;
+		};
+
+		/* Expression */
+		wval** cell;
+	};
 };
 
-wenv* wenv_new(void)
+/*
+ * Symbols, and numbers that fit in a word less one bit, are stored in
+ * the wval pointer itself rather than allocated. A number is shifted
+ * left with the low bit set and a symbol is its interned entry with bit
+ * 1 set, so lists of them are just arrays of words. Use these to read a
+ * value's type, number and symbol name.
+ */
+#define WVAL_TAGGED(v) ((uintptr_t)(v) & 3)
+#define WTYPE(v) ((uintptr_t)(v) & 1 ? WVAL_NUM : \
+	(uintptr_t)(v) & 2 ? WVAL_SYM : (v)->type)
+#define WNUM(v) ((uintptr_t)(v) & 1 ? (long)((intptr_t)(v) >> 1) : (v)->num)
+#define WNAME(v) (((wsym*)((uintptr_t)(v) & ~(uintptr_t)3))->name)
+
+/* Nursery */
+
+/*
+ * Fresh values are bump-allocated from the current nursery block. When
+ * it fills up it is reset in place if everything in it has died, which
+ * is the usual case for arithmetic temporaries, or else promoted to the
+ * old generation together with its survivors. Values never move, since
+ * C frames hold raw wval pointers, so a promoted block goes back to the
+ * pool once the last value in it is freed.
+ */
+
+#ifndef WNURSERY_BLOCK
+#define WNURSERY_BLOCK (1 << 16)
+#endif
+
+#define WNURSERY_POOL 16
+
+typedef struct wblock
 {
-	wenv* e = malloc(sizeof(wenv));
-	e->par = NULL;
-	e->count = 0;
-	e->syms = NULL;
-	e->vals = NULL;
-	return e;
-}
+	struct wblock* next;
+	void* raw;
+	int live;
+	int promoted;
+} wblock;
 
-void wenv_del(wenv* e)
+#define WBLOCK_HEAD ((sizeof(wblock) + 15) & ~(size_t)15)
+#define WBLOCK_OF(v) \
+	((wblock*)((uintptr_t)(v) & ~(uintptr_t)(WNURSERY_BLOCK-1)))
+
+struct
+{
+	wblock* block;
+	char* top;
+	char* end;
+	wblock* pool;
+	int pooled;
+	int minor_due;
+	long resets;
+	long promotions;
+} wnursery;
+
+wblock* wblock_new(void)
 {
-	for (int i = 0; i < e->count; i++)
+	if (wnursery.pool)
 	{
-		free(e->syms[i]);
-		wval_del(e->vals[i]);
+		wblock* b = wnursery.pool;
+		wnursery.pool = b->next;
+		wnursery.pooled--;
+		return b;
 	}
-	free(e->syms);
-	free(e->vals);
-	free(e);
+
+	/* Blocks are aligned to their size so a value can find its block */
+#ifdef _WIN32
+	void* raw = malloc(WNURSERY_BLOCK * 2);
+	wblock* b = (wblock*)(((uintptr_t)raw + WNURSERY_BLOCK-1)
+		& ~(uintptr_t)(WNURSERY_BLOCK-1));
+#else
+	void* raw = NULL;
+	if (posix_memalign(&raw, WNURSERY_BLOCK, WNURSERY_BLOCK) != 0) { raw = NULL; }
+	wblock* b = raw;
+#endif
+	b->raw = raw;
+	return b;
 }
 
-wval* wenv_get(wenv* e, wval* k)
+/*
+ * A promoted block counts in full towards the heap until its last value
+ * is freed, since any one survivor keeps all of it. Otherwise blocks
+ * pinned by a few cyclic values would never bring on a full collection.
+ */
+void wblock_pin(wblock* b)
 {
-	for (int i = 0; i < e->count; i++) {
-		if (strcmp(e->syms[i], k->sym) == 0) {
-			return wval_copy(e->vals[i]);
-		}
-	}
-	
-	if (e->par) {
-		return wenv_get(e->par, k);
-	} else {
-		return wval_err("Unbound symbol `%s`", k->sym);
-	}
+	b->promoted = 1;
+	wheap.live += WNURSERY_BLOCK;
 }
 
-wenv* wenv_copy(wenv* e)
+void wblock_release(wblock* b)
 {
-	wenv* n = malloc(sizeof(wenv));
-	n->par = e->par;
-	n->count = e->count;
-	n->syms = malloc(sizeof(char*) * n->count);
-	n->vals = malloc(sizeof(wval*) * n->count);
-	for (int i = 0; i < e->count; i++)
+	wheap.live -= WNURSERY_BLOCK;
+	if (wnursery.pooled == WNURSERY_POOL)
 	{
-		n->syms[i] = malloc(strlen(e->syms[i]) + 1);
-		strcpy(n->syms[i], e->syms[i]);
-		n->vals[i] = wval_copy(e->vals[i]);
+		free(b->raw);
+		return;
 	}
-	return n;
+	b->next = wnursery.pool;
+	wnursery.pool = b;
+	wnursery.pooled++;
 }
 
-/* For variable definition in loval env */
+void wnursery_refill(void)
+{
+	wblock* b = wnursery.block;
+	if (b && b->live == 0) {
+		wnursery.resets++;
+	}
+	else
+	{
+		if (b)
+		{
+			wblock_pin(b);
+			wnursery.promotions++;
+		}
+		b = wblock_new();
+		b->live = 0;
+		b->promoted = 0;
+		wnursery.block = b;
+	}
+
+	wnursery.top = (char*)b + WBLOCK_HEAD;
+	wnursery.end = (char*)b + WNURSERY_BLOCK;
+	wnursery.minor_due = 1;
+}
+
+wval* wval_alloc(void)
+{
+#ifdef WISP_NO_SLAB
+	return wheap_alloc(sizeof(wval));
+#endif
+	if ((size_t)(wnursery.end - wnursery.top) < sizeof(wval)) {
+		wnursery_refill();
+	}
+
+	wval* v = (wval*)wnursery.top;
+	wnursery.top += sizeof(wval);
+	wnursery.block->live++;
+	wheap.live += sizeof(wval);
+	return v;
+}
+
+void wval_free(wval* v)
+{
+#ifdef WISP_NO_SLAB
+	wheap_free(v, sizeof(wval));
+	return;
+#endif
+	wblock* b = WBLOCK_OF(v);
+	wheap.live -= sizeof(wval);
+	if (--b->live == 0 && b->promoted) { wblock_release(b); }
+}
+
+void wnursery_cleanup(void)
+{
+	if (wnursery.block) { free(wnursery.block->raw); }
+	while (wnursery.pool)
+	{
+		wblock* b = wnursery.pool;
+		wnursery.pool = b->next;
+		free(b->raw);
+	}
+	wnursery.block = NULL;
+	wnursery.top = wnursery.end = NULL;
+	wnursery.pooled = 0;
+}
+
+/* Form Arena */
+
+/*
+ * While a top-level form runs, small cell arrays are bump-allocated from
+ * an arena chunk rather than the slabs. Most are argument lists that die
+ * within the form, so at its end the chunk is usually empty and is just
+ * rewound. Arrays that outlive the form keep their chunk until the last
+ * of them is freed. Values bound in the global env are copied out first,
+ * so a `def` does not pin a chunk. Arrays that cannot move are not copied
+ * out otherwise, so once WARENA_PINNED chunks are held that way the rest
+ * go to the slabs until one is released.
+ */
+
+/* Larger arrays go to the heap, so one never fills a chunk */
+#define WARENA_MAX (WNURSERY_BLOCK / 64)
+
+#ifndef WARENA_PINNED
+#define WARENA_PINNED 8
+#endif
+
+struct
+{
+	int depth;
+	wblock* chunk;
+	char* top;
+	char* end;
+	int pinned;
+	long rewinds;
+	long retired;
+} warena;
+
+void warena_retire(void)
+{
+	wblock_pin(warena.chunk);
+	warena.chunk = NULL;
+	warena.pinned++;
+	warena.retired++;
+}
+
+void warena_rewind(void)
+{
+	warena.top = (char*)warena.chunk + WBLOCK_HEAD;
+	warena.end = (char*)warena.chunk + WNURSERY_BLOCK;
+}
+
+/* Returns NULL when a new chunk is needed but too many are pinned */
+void* warena_alloc(size_t n)
+{
+	n = (n + 15) & ~(size_t)15;
+	if (!warena.chunk || (size_t)(warena.end - warena.top) < n)
+	{
+		if (warena.chunk && warena.chunk->live > 0) { warena_retire(); }
+		if (!warena.chunk)
+		{
+			if (warena.pinned >= WARENA_PINNED) { return NULL; }
+			warena.chunk = wblock_new();
+			warena.chunk->live = 0;
+			warena.chunk->promoted = 0;
+		}
+		warena_rewind();
+	}
+
+	void* p = warena.top;
+	warena.top += n;
+	warena.chunk->live++;
+	return p;
+}
+
+void warena_free(void* p)
+{
+	wblock* b = WBLOCK_OF(p);
+	if (--b->live == 0 && b->promoted)
+	{
+		wblock_release(b);
+		warena.pinned--;
+	}
+}
+
+void warena_begin(void)
+{
+	warena.depth++;
+}
+
+void warena_end(void)
+{
+	if (--warena.depth > 0 || !warena.chunk) { return; }
+
+	if (warena.chunk->live == 0)
+	{
+		warena_rewind();
+		warena.rewinds++;
+	}
+	else {
+		warena_retire();
+	}
+}
+
+void warena_cleanup(void)
+{
+	if (warena.chunk) { free(warena.chunk->raw); }
+	warena.chunk = NULL;
+}
+
+/* Constant Values */
+
+/*
+ * Results that never vary, like the `()` returned by def and print, are
+ * single static values. wval_copy and wval_del pass over them like the
+ * tagged numbers, so returning one costs no allocation.
+ */
+
+enum { WCONST_UNIT, WCONST_DIV_ZERO, WCONST_BAD_NUM, WCONST_COUNT };
+
+wval wconst[WCONST_COUNT];
+
+#define WVAL_CONST(v) ((uintptr_t)(v) - (uintptr_t)wconst < sizeof(wconst))
+
+void wconst_init(void)
+{
+	wconst[WCONST_UNIT].type = WVAL_SEXPR;
+	wconst[WCONST_DIV_ZERO].type = WVAL_ERR;
+	wconst[WCONST_DIV_ZERO].err = "Division by zero!";
+	wconst[WCONST_BAD_NUM].type = WVAL_ERR;
+	wconst[WCONST_BAD_NUM].err = "Invalid number";
+}
+
+/* The empty S-Expression as a result, never to be added to in place */
+wval* wval_unit(void)
+{
+	return &wconst[WCONST_UNIT];
+}
+
+wval* wval_err(char* fmt, ...)
+{
+	wval* v = wval_alloc();
+	v->type = WVAL_ERR;
+
+	va_list va;
+	va_start(va, fmt);
+
+	v->err = wheap_alloc(512);
+	vsnprintf(v->err, 511, fmt, va);
+
+	v->err = wheap_realloc(v->err, 512, strlen(v->err)+1);
+
+	va_end(va);
+	return v;
+}
+
+wval* wval_num(long x)
+{
+	if (x >= LONG_MIN / 2 && x <= LONG_MAX / 2) {
+		return (wval*)(((uintptr_t)x << 1) | 1);
+	}
+
+	wval* v = wval_alloc();
+	v->type = WVAL_NUM;
+	v->num = x;
+	return v;
+}
+
+wval* wval_sym_n(char* s, size_t n)
+{
+	return (wval*)((uintptr_t)WSYM(wsym_intern_n(s, n)) | 2);
+}
+
+wval* wval_sym(char* s)
+{
+	return wval_sym_n(s, strlen(s));
+}
+
+wval* wval_str(char *s)
+{
+	wval* v = wval_alloc();
+	v->type = WVAL_STR;
+	v->str = wheap_alloc(strlen(s) + 1);
+	strcpy(v->str, s);
+	return v;
+}
+
+wval* wval_builtin(wbuiltin func)
+{
+	wval* v = wval_alloc();
+	v->type = WVAL_FUN;
+	v->builtin = func;
+	v->env = NULL;
+	v->formals = NULL;
+	v->body = NULL;
+	return v;
+}
+
+/* Cell arrays are shared between copies and copied on write */
+typedef struct
+{
+	wgc gc;
+	int count;
+	int arena;
+	wval* items[];
+} wcells;
+
+#define WCELLS(cell) ((wcells*)((char*)(cell) - offsetof(wcells, items)))
+#define WCELLS_SIZE(n) (sizeof(wcells) + sizeof(wval*) * (n))
+
+/* Allocates untracked room for n cells, in the arena if a form is running */
+wcells* wcells_alloc(int n)
+{
+	size_t size = WCELLS_SIZE(n);
+	wcells* c;
+#ifndef WISP_NO_SLAB
+	if (warena.depth && size <= WARENA_MAX && (c = warena_alloc(size)))
+	{
+		wheap.live += size;
+		c->arena = 1;
+		return c;
+	}
+#endif
+	c = wheap_alloc(size);
+	c->arena = 0;
+	return c;
+}
+
+void wcells_free(wcells* c)
+{
+	if (!c->arena)
+	{
+		wheap_free(c, WCELLS_SIZE(c->count));
+		return;
+	}
+	wheap.live -= WCELLS_SIZE(c->count);
+	warena_free(c);
+}
+
+wcells* wcells_new(int n)
+{
+	wcells* c = wcells_alloc(n);
+	wheap_track(&c->gc, WGC_CELLS);
+	c->count = n;
+	return c;
+}
+
+void wval_del(wval* v);
+
+void wcells_del(wcells* c)
+{
+	for (int i = 0; i < c->count; i++) {
+		if (c->items[i]) { wval_del(c->items[i]); }
+	}
+	wheap_untrack(&c->gc);
+	wcells_free(c);
+}
+
+/* Sets the capacity of v's cells, with any new slots NULL */
+void wval_cells_resize(wval* v, int n)
+{
+	if (!v->cell)
+	{
+		v->cell = wcells_new(n)->items;
+		memset(v->cell, 0, sizeof(wval*) * n);
+		return;
+	}
+
+	wcells* c = WCELLS(v->cell);
+	if (n == 0)
+	{
+		wheap_untrack(&c->gc);
+		wcells_free(c);
+		v->cell = NULL;
+		return;
+	}
+
+	int from = c->count;
+	if (c->arena)
+	{
+		/* Arena cells cannot grow in place, so move them */
+		wcells* x = wcells_alloc(n);
+		int arena = x->arena;
+		memcpy(x, c, WCELLS_SIZE(from < n ? from : n));
+		x->arena = arena;
+		wcells_free(c);
+		c = x;
+	}
+	else {
+		c = wheap_realloc(c, WCELLS_SIZE(c->count), WCELLS_SIZE(n));
+	}
+	wheap_moved(&c->gc);
+	c->count = n;
+	v->cell = c->items;
+	if (n > from) { memset(&c->items[from], 0, sizeof(wval*) * (n - from)); }
+}
+
+wval* wval_sexpr(void)
+{
+	wval* v = wval_alloc();
+	v->type = WVAL_SEXPR;
+	v->count = 0;
+	v->cell = NULL;
+	return v;
+}
+
+wval* wval_qexpr(void)
+{
+	wval* v = wval_alloc();
+	v->type = WVAL_QEXPR;
+	v->count = 0;
+	v->cell = NULL;
+	return v;
+}
+
+wenv* wenv_new(void);
+wenv* wenv_share(wenv* e);
+wcode* wcode_compile(wval* formals, wval* body);
+wcode* wcode_share(wcode* c);
+void wcode_del(wcode* c);
+
+/* Closes over env, the scope the lambda is made in */
+wval* wval_lambda(wenv* env, wval* formals, wval* body)
+{
+	wval* v = wval_alloc();
+	v->type = WVAL_FUN;
+	v->builtin = NULL;
+	v->env = wenv_share(env);
+	v->formals = formals;
+	v->body = body;
+	v->code = wcode_compile(formals, body);
+	v->args = NULL;
+	return v;
+}
+
+void wenv_del(wenv* e);
+
+void wval_del(wval* v)
+{
+	if (WVAL_TAGGED(v) || WVAL_CONST(v)) { return; }
+
+	switch (v->type)
+	{
+		case WVAL_NUM: break;
+		case WVAL_FUN: 
+			if (!v->builtin) 
+			{
+				wenv_del(v->env);
+				wval_del(v->formals);
+				wval_del(v->body);
+				wcode_del(v->code);
+				if (v->args) { wval_del(v->args); }
+			}
+			break;
+		case WVAL_ERR: wheap_free(v->err, strlen(v->err) + 1); break;
+		case WVAL_STR: wheap_free(v->str, strlen(v->str) + 1); break;
+		case WVAL_QEXPR:
+		case WVAL_SEXPR:
+			if (v->cell && --WCELLS(v->cell)->gc.refs == 0) {
+				wcells_del(WCELLS(v->cell));
+			}
+			break;
+	}
+	wval_free(v);
+}
+
+wval* wval_copy(wval* v)
+{
+	if (WVAL_TAGGED(v) || WVAL_CONST(v)) { return v; }
+
+	wval* x = wval_alloc();
+	x->type = v->type;
+
+	switch (v->type)
+	{
+		case WVAL_FUN: 
+			if (v->builtin) {
+				x->builtin = v->builtin;
+			} else {
+				x->builtin = NULL;
+				x->env = wenv_share(v->env);
+				x->formals = wval_copy(v->formals);
+				x->body = wval_copy(v->body);
+				x->code = v->code ? wcode_share(v->code) : NULL;
+				x->args = v->args ? wval_copy(v->args) : NULL;
+			}
+			break;
+		case WVAL_NUM: x->num = v->num; break;
+		case WVAL_ERR:
+			x->err = wheap_alloc(strlen(v->err) + 1);
+			strcpy(x->err, v->err); break;
+		case WVAL_STR:
+			x->str = wheap_alloc(strlen(v->str) +1);
+			strcpy(x->str, v->str); break;
+		case WVAL_SEXPR:
+		case WVAL_QEXPR:
+			x->count = v->count;
+			x->cell = v->cell;
+			if (x->cell) { WCELLS(x->cell)->gc.refs++; }
+			break;
+	}
+	return x;
+}
+
+/* Gives v its own cell array before the cells are modified */
+wval* wval_unshare(wval* v)
+{
+	if (!v->cell || WCELLS(v->cell)->gc.refs == 1) { return v; }
+
+	wcells* c = wcells_new(v->count);
+	for (int i = 0; i < v->count; i++) {
+		c->items[i] = wval_copy(v->cell[i]);
+	}
+
+	WCELLS(v->cell)->gc.refs--;
+	v->cell = c->items;
+	return v;
+}
+
+/* Moves any of v's cells still in the form arena out to the heap */
+void wval_promote(wval* v)
+{
+	if (WVAL_TAGGED(v)) { return; }
+
+	if (v->type == WVAL_FUN && !v->builtin)
+	{
+		wval_promote(v->formals);
+		wval_promote(v->body);
+		if (v->args) { wval_promote(v->args); }
+		return;
+	}
+	if ((v->type != WVAL_SEXPR && v->type != WVAL_QEXPR) || !v->cell) { return; }
+
+	wcells* c = WCELLS(v->cell);
+	if (!c->arena) { return; }
+
+	wcells* x = wheap_alloc(WCELLS_SIZE(v->count));
+	x->arena = 0;
+	wheap_track(&x->gc, WGC_CELLS);
+	x->count = v->count;
+
+	if (c->gc.refs == 1)
+	{
+		memcpy(x->items, c->items, sizeof(wval*) * v->count);
+		wheap_untrack(&c->gc);
+		wcells_free(c);
+	}
+	else {
+		for (int i = 0; i < v->count; i++) {
+			x->items[i] = wval_copy(c->items[i]);
+		}
+		c->gc.refs--;
+	}
+	v->cell = x->items;
+
+	for (int i = 0; i < v->count; i++) {
+		wval_promote(v->cell[i]);
+	}
+}
+
+/* Grows the cells geometrically, so building a list is linear */
+wval* wval_add(wval* v, wval* x)
+{
+	if (WVAL_CONST(v)) { v = wval_sexpr(); }
+	wval_unshare(v);
+	int cap = v->cell ? WCELLS(v->cell)->count : 0;
+	if (v->count == cap) { wval_cells_resize(v, cap ? cap * 2 : 4); }
+	v->cell[v->count++] = x;
+	return v;
+}
+
+/* Leaves the cell array its size, with the freed slot at the end NULL */
+wval* wval_pop(wval* v, int i)
+{
+	wval_unshare(v);
+	wval* x = v->cell[i];
+	memmove(&v->cell[i], 
+		&v->cell[i+1],
+		sizeof(wval*) * (v->count-i-1));
+	v->count--;
+	v->cell[v->count] = NULL;
+	return x;
+}
+
+wval* wval_take(wval* v, int i)
+{
+	wval* x = wval_pop(v, i);
+	wval_del(v);
+	return x;
+}
+
+/*
+ * Moves the items of v from i on into to, leaving NULL behind, or copies
+ * them when v shares its cells.
+ */
+void wval_move_cells(wval** to, wval* v, int i)
+{
+	if (WCELLS(v->cell)->gc.refs > 1)
+	{
+		for (int j = i; j < v->count; j++) { *to++ = wval_copy(v->cell[j]); }
+		return;
+	}
+
+	for (int j = i; j < v->count; j++)
+	{
+		*to++ = v->cell[j];
+		v->cell[j] = NULL;
+	}
+	v->count = i;
+}
+
+/* Returns the items of v from i on as a new list of the same type */
+wval* wval_slice(wval* v, int i)
+{
+	wval* x = WTYPE(v) == WVAL_QEXPR ? wval_qexpr() : wval_sexpr();
+	int n = v->count - i;
+	if (n <= 0) { return x; }
+
+	wval_cells_resize(x, n);
+	wval_move_cells(x->cell, v, i);
+	x->count = n;
+	return x;
+}
+
+wval* wval_join(wval* x, wval* y)
+{
+	if (y->count)
+	{
+		wval_unshare(x);
+		int n = x->count;
+		wval_cells_resize(x, n + y->count);
+		x->count = n + y->count;
+		wval_move_cells(x->cell + n, y, 0);
+	}
+
+	wval_del(y);
+	return x;
+}
+
+int wval_eq(wval* x, wval* y);
+
+/* Lambdas are equal when the formals still to be given and bodies are */
+int wval_fun_eq(wval* x, wval* y)
+{
+	int i = x->args ? x->args->count : 0;
+	int j = y->args ? y->args->count : 0;
+	if (x->formals->count - i != y->formals->count - j) { return 0; }
+
+	for (; i < x->formals->count; i++, j++) {
+		if (!wval_eq(x->formals->cell[i], y->formals->cell[j])) { return 0; }
+	}
+	return wval_eq(x->body, y->body);
+}
+
+int wval_eq(wval* x, wval* y)
+{
+	if (WTYPE(x) != WTYPE(y)) { return 0; }
+
+	switch (WTYPE(x))
+	{
+		case WVAL_NUM: return (WNUM(x) == WNUM(y));
+		case WVAL_ERR: return (strcmp(x->err, y->err) == 0);
+		case WVAL_SYM: return (WNAME(x) == WNAME(y));
+		case WVAL_STR: return (strcmp(x->str, y->str) == 0);
+		case WVAL_FUN:
+			if (x->builtin || y->builtin) {
+				return x->builtin == y->builtin;
+			} else {
+				return wval_fun_eq(x, y);
+			}
+		case WVAL_QEXPR:
+		case WVAL_SEXPR:
+			if (x->count != y->count) { return 0; }
+			for (int i = 0; i < x->count; i++) {
+				if (!wval_eq(x->cell[i], y->cell[i])) { return 0; }
+			}
+			return 1;
+		break;
+	}
+	return 0;
+}
+
+void wval_print_str(wval* v)
+{
+	char* escaped = malloc(strlen(v->str) + 1);
+	strcpy(escaped, v->str);
+	escaped = mpcf_escape(escaped);
+	printf("\"%s\"", escaped);
+	free(escaped);
+}
+
+void wval_print(wval* v);
+/* Prints the cells of v from the one at index from */
+void wval_expr_print(wval* v, int from, char open, char close)
+{
+	putchar(open);
+	for (int i = from; i < v->count; i++)
+	{
+		wval_print(v->cell[i]);
+		if (i != (v->count-1)) { 
+			putchar(' '); 
+		}
+	}
+	putchar(close);
+}
+
+void wval_print(wval* v)
+{
+	switch (WTYPE(v))
+	{
+		case WVAL_NUM:   printf("%li", WNUM(v)); break;
+		case WVAL_ERR:   printf("Error: %s", v->err); break;
+		case WVAL_SYM:	 printf("%s", WNAME(v)); break;
+		case WVAL_STR:   wval_print_str(v); break;
+		case WVAL_SEXPR: wval_expr_print(v, 0, '(', ')'); break;
+		case WVAL_QEXPR: wval_expr_print(v, 0, '{', '}'); break;
+		case WVAL_FUN:
+			if (v->builtin) {
+				printf("<builtin>");
+			} else {
+				printf("(\\ ");
+				wval_expr_print(v->formals,
+					v->args ? v->args->count : 0, '{', '}');
+				putchar(' '); wval_print(v->body); putchar(')');
+			}
+			break;
+	}
+}
+
+void wval_println(wval* v)
+{
+	printf("    <~  ");
+	wval_print(v);
+	putchar('\n');
+}
+
+char* wtype_name(int t)
+{
+	switch(t)
+	{
+		case WVAL_FUN:   return "Function";
+		case WVAL_NUM:   return "Number";
+		case WVAL_ERR:   return "Error";
+		case WVAL_SYM:   return "Symbol";
+		case WVAL_STR:   return "String";
+		case WVAL_SEXPR: return "S-Expression";
+		case WVAL_QEXPR: return "Q-Expression";
+		default:         return "Unknown";
+	}
+}
+
+/* Wisp Environment */
+
+/* Open-addressing table keyed by interned symbol pointers */
+typedef struct
+{
+	char* sym;
+	wval* val;
+} wbind;
+
+/* Marks a deleted slot so probing continues past it */
+char wenv_tomb;
+#define WENV_TOMB (&wenv_tomb)
+
+struct wenv
+{
+	wgc gc;
+	wenv* par;
+	int count;
+	int used;
+	int cap;
+	wbind* binds;
+
+	/* Capacity of a call frame's table, allocated inline after it */
+	int inl;
+};
+
+#define WENV_INLINE(e) ((wbind*)((e) + 1))
+
+/* The top-level env, whose bindings are the globals */
+wenv* wenv_root;
+
+wenv* wenv_new(void)
+{
+	wenv* e = wheap_alloc(sizeof(wenv));
+	wheap_track(&e->gc, WGC_ENV);
+	e->par = NULL;
+	e->count = 0;
+	e->used = 0;
+	e->cap = 0;
+	e->binds = NULL;
+	e->inl = 0;
+	return e;
+}
+
+/* A call frame whose table of cap slots comes in the same allocation */
+wenv* wenv_frame(int cap)
+{
+	wenv* e = wheap_alloc(sizeof(wenv) + sizeof(wbind) * cap);
+	wheap_track(&e->gc, WGC_ENV);
+	e->par = NULL;
+	e->count = 0;
+	e->used = 0;
+	e->cap = cap;
+	e->binds = WENV_INLINE(e);
+	e->inl = cap;
+	memset(e->binds, 0, sizeof(wbind) * cap);
+	return e;
+}
+
+/* Tracks how many local frames bind sym, so globals can skip the chain */
+void wenv_count(wenv* e, char* sym, int n)
+{
+	if (e != wenv_root) { WSYM(sym)->locals += n; }
+}
+
+void wenv_free_binds(wenv* e)
+{
+	if (e->binds != WENV_INLINE(e)) {
+		wheap_free(e->binds, sizeof(wbind) * e->cap);
+	}
+}
+
+/* Drops every binding and the parent link, leaving an empty table */
+void wenv_clear(wenv* e)
+{
+	for (int i = 0; i < e->cap; i++)
+	{
+		char* sym = e->binds[i].sym;
+		if (sym && sym != WENV_TOMB)
+		{
+			wval_del(e->binds[i].val);
+			wenv_count(e, sym, -1);
+		}
+	}
+	wenv_free_binds(e);
+	e->binds = NULL;
+	e->count = e->used = e->cap = 0;
+
+	if (e->par)
+	{
+		wenv_del(e->par);
+		e->par = NULL;
+	}
+}
+
+void wenv_del(wenv* e)
+{
+	if (--e->gc.refs > 0) { return; }
+
+	wenv_clear(e);
+	wheap_untrack(&e->gc);
+	wheap_free(e, sizeof(wenv) + sizeof(wbind) * e->inl);
+}
+
+/* Returns the slot holding sym, or -1 if it is not bound at this level */
+int wenv_find(wenv* e, char* sym)
+{
+	if (e->count == 0) { return -1; }
+
+	unsigned long i = whash_ptr(sym) & (e->cap-1);
+	while (e->binds[i].sym)
+	{
+		if (e->binds[i].sym == sym) { return i; }
+		i = (i+1) & (e->cap-1);
+	}
+	return -1;
+}
+
+/* Rehashes live bindings, dropping tombstones and doubling when crowded */
+void wenv_grow(wenv* e)
+{
+	int cap = e->cap ? e->cap : 8;
+	if ((e->count+1) * 2 > cap) { cap *= 2; }
+
+	wbind* binds = wheap_calloc(cap, sizeof(wbind));
+	for (int i = 0; i < e->cap; i++)
+	{
+		char* sym = e->binds[i].sym;
+		if (!sym || sym == WENV_TOMB) { continue; }
+		unsigned long j = whash_ptr(sym) & (cap-1);
+		while (binds[j].sym) { j = (j+1) & (cap-1); }
+		binds[j] = e->binds[i];
+	}
+
+	wenv_free_binds(e);
+	e->binds = binds;
+	e->cap = cap;
+	e->used = e->count;
+}
+
+wval* wenv_lookup(wenv* e, char* sym)
+{
+	for (; e; e = e->par)
+	{
+		int i = wenv_find(e, sym);
+		if (i >= 0) { return wval_copy(e->binds[i].val); }
+	}
+	return wval_err("Unbound symbol `%s`", sym);
+}
+
+wval* wenv_get(wenv* e, wval* k)
+{
+	return wenv_lookup(e, WNAME(k));
+}
+
+wenv* wenv_share(wenv* e)
+{
+	e->gc.refs++;
+	return e;
+}
+
+/* Binds sym to v at this level, taking ownership of v */
+void wenv_bind(wenv* e, char* sym, wval* v)
+{
+	/* Globals outlive the form that defined them */
+	if (e == wenv_root) { wval_promote(v); }
+
+	int i = wenv_find(e, sym);
+	if (i >= 0)
+	{
+		wval_del(e->binds[i].val);
+		e->binds[i].val = v;
+		return;
+	}
+
+	if ((e->used+1) * 4 > e->cap * 3) { wenv_grow(e); }
+
+	/* Reuse the first tombstone on the probe path */
+	unsigned long j = whash_ptr(sym) & (e->cap-1);
+	while (e->binds[j].sym && e->binds[j].sym != WENV_TOMB) {
+		j = (j+1) & (e->cap-1);
+	}
+	if (!e->binds[j].sym) { e->used++; }
+
+	e->binds[j].sym = sym;
+	e->binds[j].val = v;
+	e->count++;
+	wenv_count(e, sym, 1);
+}
+
+/* Binds sym in a fresh frame at slot i, where probing would have put it */
+void wenv_bind_at(wenv* e, int i, char* sym, wval* v)
+{
+	e->binds[i].sym = sym;
+	e->binds[i].val = v;
+	e->count++;
+	e->used++;
+	wenv_count(e, sym, 1);
+}
+
+/* For variable definition in loval env */
 void wenv_put(wenv* e, wval* k, wval* v)
 {
-	for (int i = 0; i < e->count; i++) {
-		if (strcmp(e->syms[i], k->sym) == 0)
+	wenv_bind(e, WNAME(k), wval_copy(v));
+}
+
+/* For removing a variable, leaving a tombstone so later probes still match */
+int wenv_rem(wenv* e, wval* k)
+{
+	int i = wenv_find(e, WNAME(k));
+	if (i < 0) { return 0; }
+
+	wval_del(e->binds[i].val);
+	wenv_count(e, WNAME(k), -1);
+	e->binds[i].sym = WENV_TOMB;
+	e->binds[i].val = NULL;
+	e->count--;
+	return 1;
+}
+
+/* For variable definition in global env */
+void wenv_def(wenv* e, wval* k, wval* v)
+{
+	while (e->par) { e = e->par; }
+	wenv_put(e, k, v);
+}
+
+/* Garbage Collection */
+
+/*
+ * Reference counts free acyclic garbage as soon as it is dropped. The
+ * collector finds what they cannot: containers kept alive only by
+ * references from each other. Roots are the containers whose counts
+ * are not fully explained by references from other heap containers,
+ * which are exactly those held by the REPL or builtin_load top-level
+ * env and by the evaluation stack.
+ */
+
+typedef void (*wgc_visit)(wgc* g);
+
+void wcode_traverse(wcode* c, wgc_visit visit);
+void wcode_clear(wcode* c);
+
+void wgc_traverse_val(wval* v, wgc_visit visit)
+{
+	switch (WTYPE(v))
+	{
+		case WVAL_FUN:
+			if (!v->builtin)
+			{
+				visit(&v->env->gc);
+				wgc_traverse_val(v->formals, visit);
+				wgc_traverse_val(v->body, visit);
+				if (v->args) { wgc_traverse_val(v->args, visit); }
+				if (v->code) { visit((wgc*)v->code); }
+			}
+			break;
+		case WVAL_SEXPR:
+		case WVAL_QEXPR:
+			if (v->cell) { visit(&WCELLS(v->cell)->gc); }
+			break;
+	}
+}
+
+void wgc_traverse(wgc* g, wgc_visit visit)
+{
+	if (g->kind == WGC_CELLS)
+	{
+		wcells* c = (wcells*)g;
+		for (int i = 0; i < c->count; i++) {
+			if (c->items[i]) { wgc_traverse_val(c->items[i], visit); }
+		}
+	}
+	else if (g->kind == WGC_CODE) {
+		wcode_traverse((wcode*)g, visit);
+	}
+	else
+	{
+		wenv* e = (wenv*)g;
+		if (e->par) { visit(&e->par->gc); }
+		for (int i = 0; i < e->cap; i++)
+		{
+			if (e->binds[i].sym && e->binds[i].sym != WENV_TOMB) {
+				wgc_traverse_val(e->binds[i].val, visit);
+			}
+		}
+	}
+}
+
+struct
+{
+	int count;
+	int cap;
+	wgc** items;
+} wgc_stack;
+
+/* Oldest generation taking part in the current collection */
+int wgc_gen;
+
+void wgc_unref(wgc* g)
+{
+	if (g->gen <= wgc_gen) { g->gc_refs--; }
+}
+
+void wgc_mark(wgc* g)
+{
+	if (g->gen > wgc_gen || g->marked) { return; }
+	g->marked = 1;
+
+	if (wgc_stack.count == wgc_stack.cap)
+	{
+		wgc_stack.cap = wgc_stack.cap ? wgc_stack.cap * 2 : 256;
+		wgc_stack.items = realloc(wgc_stack.items, sizeof(wgc*) * wgc_stack.cap);
+	}
+	wgc_stack.items[wgc_stack.count++] = g;
+}
+
+/*
+ * A minor collection (gen 0) only considers young containers; any
+ * reference from the old generation counts as a root. A full
+ * collection (gen 1) considers everything.
+ */
+void wgc_collect_gen(int gen)
+{
+	clock_t start = clock();
+	wgc* lists[] = { &wheap.young, &wheap.old };
+	wgc_gen = gen;
+
+	/* Subtract the references each container gets from other containers */
+	for (int l = 0; l <= gen; l++)
+	{
+		for (wgc* g = lists[l]->next; g != lists[l]; g = g->next)
+		{
+			g->gc_refs = g->refs;
+			g->marked = 0;
+		}
+	}
+	for (int l = 0; l <= gen; l++) {
+		for (wgc* g = lists[l]->next; g != lists[l]; g = g->next) {
+			wgc_traverse(g, wgc_unref);
+		}
+	}
+
+	/* Mark everything reachable from a root */
+	for (int l = 0; l <= gen; l++) {
+		for (wgc* g = lists[l]->next; g != lists[l]; g = g->next) {
+			if (g->gc_refs > 0) { wgc_mark(g); }
+		}
+	}
+	while (wgc_stack.count) {
+		wgc_traverse(wgc_stack.items[--wgc_stack.count], wgc_mark);
+	}
+
+	/* Hold the garbage while its contents are cleared, then release it */
+	wgc garbage;
+	garbage.prev = garbage.next = &garbage;
+	for (int l = 0; l <= gen; l++)
+	{
+		for (wgc* g = lists[l]->next, *next; g != lists[l]; g = next)
+		{
+			next = g->next;
+			if (g->marked) { continue; }
+			wheap_untrack(g);
+			g->prev = garbage.prev;
+			g->next = &garbage;
+			garbage.prev->next = g;
+			garbage.prev = g;
+			g->refs++;
+		}
+	}
+
+	for (wgc* g = garbage.next; g != &garbage; g = g->next)
+	{
+		if (g->kind == WGC_CELLS)
+		{
+			wcells* c = (wcells*)g;
+			for (int i = 0; i < c->count; i++)
+			{
+				if (c->items[i]) { wval_del(c->items[i]); }
+				c->items[i] = NULL;
+			}
+		}
+		else if (g->kind == WGC_CODE) {
+			wcode_clear((wcode*)g);
+		}
+		else {
+			wenv_clear((wenv*)g);
+		}
+	}
+
+	while (garbage.next != &garbage)
+	{
+		wgc* g = garbage.next;
+		if (g->kind == WGC_CELLS) {
+			wcells_del((wcells*)g);
+		} else if (g->kind == WGC_CODE) {
+			g->refs = 1;
+			wcode_del((wcode*)g);
+		} else {
+			g->refs = 1;
+			wenv_del((wenv*)g);
+		}
+		wheap.reclaimed++;
+	}
+
+	/* Survivors are promoted to the old generation */
+	for (wgc* g = wheap.young.next; g != &wheap.young; g = g->next) {
+		g->gen = 1;
+	}
+	if (wheap.young.next != &wheap.young)
+	{
+		wheap.young.next->prev = &wheap.old;
+		wheap.young.prev->next = wheap.old.next;
+		wheap.old.next->prev = wheap.young.prev;
+		wheap.old.next = wheap.young.next;
+		wheap.young.prev = wheap.young.next = &wheap.young;
+	}
+
+	if (gen > 0)
+	{
+		size_t next = wheap.live / 100 * wheap.growth;
+		wheap.threshold = next > WGC_MIN_HEAP ? next : WGC_MIN_HEAP;
+		wheap.collections++;
+	}
+	else {
+		wheap.minors++;
+	}
+
+	double pause = (double)(clock() - start) / CLOCKS_PER_SEC;
+	wheap.pause_total += pause;
+	if (pause > wheap.pause_max) { wheap.pause_max = pause; }
+}
+
+void wgc_collect(void)
+{
+	wgc_collect_gen(1);
+}
+
+/* Called where every heap container is in a consistent state */
+void wgc_poll(void)
+{
+	if (wheap.live > wheap.threshold)
+	{
+		wgc_collect();
+		wnursery.minor_due = 0;
+	}
+	else if (wnursery.minor_due)
+	{
+		wgc_collect_gen(0);
+		wnursery.minor_due = 0;
+	}
+}
+
+/* Builtins */
+
+#define WASSERT(args, cond, fmt, ...) \
+	if (!(cond)) { \
+		wval* err = wval_err(fmt, ##__VA_ARGS__); \
+		wval_del(args); \
+		return err; \
+	}
+
+#define WASSERT_TYPE(func, args, index, expect) \
+	WASSERT(args, WTYPE(args->cell[index]) == expect, \
+		"Function '%s' passed incorrect type for argument %i. Got %s, Expected %s", \
+		func, index, wtype_name(WTYPE(args->cell[index])), wtype_name(expect))
+
+#define WASSERT_NUM(func, args, num) \
+	WASSERT(args, args->count == num, \
+		"Funcion '%s' passed incorrect number of arguments. Got %i, Expected %i.", \
+		func, args->count, num)
+
+#define WASSERT_NOT_EMPTY(func, args, index) \
+	WASSERT(args, args->cell[index]->count != 0, \
+		"Function '%s' passed {} for argument %i.", func, index);
+
+wval* wval_eval(wenv* e, wval* v);
+
+wval* builtin_head(wenv* e, wval* a)
+{
+	WASSERT_NUM("head", a, 1);
+	WASSERT_TYPE("head", a, 0, WVAL_QEXPR);
+	WASSERT_NOT_EMPTY("head", a, 0);
+	
+	wval* v = wval_add(wval_qexpr(), wval_copy(a->cell[0]->cell[0]));
+	wval_del(a);
+	return v;
+}
+
+wval* builtin_tail(wenv* e, wval* a)
+{
+	WASSERT_NUM("tail", a, 1);
+	WASSERT_TYPE("tail", a, 0, WVAL_QEXPR);
+	WASSERT_NOT_EMPTY("tail", a, 0);
+
+	wval* v = wval_slice(a->cell[0], 1);
+	wval_del(a);
+	return v;
+}
+
+wval* builtin_list(wenv* e, wval* a)
+{
+	a->type = WVAL_QEXPR;
+	return a;
+}
+
+wval* builtin_join(wenv* e, wval* a)
+{
+	for (int i = 0; i < a->count; i++) {
+		WASSERT_TYPE("join", a, i, WVAL_QEXPR); 
+	}
+	
+	wval_unshare(a);
+	wval* x = a->cell[0];
+	a->cell[0] = NULL;
+	for (int i = 1; i < a->count; i++)
+	{
+		x = wval_join(x, a->cell[i]);
+		a->cell[i] = NULL;
+	}
+	
+	wval_del(a);
+	return x;
+}
+
+/* Checks the argument to `eval` and returns it as an S-Expression */
+wval* builtin_eval_expr(wval* a)
+{
+	WASSERT_NUM("eval", a, 1);
+	WASSERT_TYPE("eval", a, 0, WVAL_QEXPR);
+
+	wval* x = wval_take(a, 0);
+	x->type = WVAL_SEXPR;
+	return x;
+}
+
+wval* builtin_eval(wenv* e, wval* a)
+{
+	return wval_eval(e, builtin_eval_expr(a));
+}
+
+/*
+ * Arithmetic kernels fold a flat vector of n >= 1 numbers into r,
+ * returning 0 on division by zero.
+ */
+typedef int (*wop)(wval** v, int n, long* r);
+
+int wop_add(wval** v, int n, long* r)
+{
+	long x = WNUM(v[0]);
+	for (int i = 1; i < n; i++) { x += WNUM(v[i]); }
+	*r = x;
+	return 1;
+}
+
+int wop_sub(wval** v, int n, long* r)
+{
+	long x = WNUM(v[0]);
+	if (n == 1) { x = -x; }
+	for (int i = 1; i < n; i++) { x -= WNUM(v[i]); }
+	*r = x;
+	return 1;
+}
+
+int wop_mul(wval** v, int n, long* r)
+{
+	long x = WNUM(v[0]);
+	for (int i = 1; i < n; i++) { x *= WNUM(v[i]); }
+	*r = x;
+	return 1;
+}
+
+int wop_div(wval** v, int n, long* r)
+{
+	long x = WNUM(v[0]);
+	for (int i = 1; i < n; i++)
+	{
+		if (WNUM(v[i]) == 0) { return 0; }
+		x /= WNUM(v[i]);
+	}
+	*r = x;
+	return 1;
+}
+
+wval* builtin_op(wenv* e, wval* a, char* op, wop kernel)
+{
+	for (int i = 0; i < a->count; i++) {
+		WASSERT_TYPE(op, a, i, WVAL_NUM);	
+	}
+	
+	long r;
+	wval* x = kernel(a->cell, a->count, &r) ?
+		wval_num(r) : &wconst[WCONST_DIV_ZERO];
+	wval_del(a);
+	return x;
+}
+
+wval* builtin_add(wenv* e, wval* a) { return builtin_op(e, a, "+", wop_add); }
+wval* builtin_sub(wenv* e, wval* a) { return builtin_op(e, a, "-", wop_sub); }
+wval* builtin_mul(wenv* e, wval* a) { return builtin_op(e, a, "*", wop_mul); }
+wval* builtin_div(wenv* e, wval* a) { return builtin_op(e, a, "/", wop_div); }
+
+wval* builtin_var(wenv* e, wval* a, char* func)
+{
+	WASSERT_TYPE("def", a, 0, WVAL_QEXPR);
+
+	wval* syms = a->cell[0];
+	for (int i = 0; i < syms->count; i++)
+	{
+		WASSERT(a, (WTYPE(syms->cell[i]) == WVAL_SYM),
+			"Function '%s' cannot define non-symbol! ",
+			"Got %s, Expected %s.", func,
+			wtype_name(WTYPE(syms->cell[i])), 
+			wtype_name(WVAL_SYM));
+	}
+
+	WASSERT(a, (syms->count == a->count-1),
+		"Function '%s' passed incorrect number of arguments for symbols. "
+		"Got %i, Expected %i.",
+		func, syms->count, a->count-1);
+
+	for (int i = 0; i < syms->count; i++) 
+	{
+		if (strcmp(func, "def") == 0) {
+			wenv_def(e, syms->cell[i], a->cell[i+1]);
+		}
+
+		if (strcmp(func, "=")   == 0) {
+			wenv_put(e, syms->cell[i], a->cell[i+1]);
+		}
+	}
+
+	wval_del(a);
+	return wval_unit();
+}
+
+wval* builtin_def(wenv* e, wval* a) { return builtin_var(e, a, "def"); }
+wval* builtin_put(wenv* e, wval* a) { return builtin_var(e, a, "="); }
+
+wval* builtin_lambda(wenv* e, wval* a)
+{
+	WASSERT_NUM("\\", a, 2);
+	WASSERT_TYPE("\\", a, 0, WVAL_QEXPR);
+	WASSERT_TYPE("\\", a, 1, WVAL_QEXPR);
+
+	for (int i = 0; i < a->cell[0]->count; i++)
+	{
+		WASSERT(a, (WTYPE(a->cell[0]->cell[i]) == WVAL_SYM),
+			"Cannot define non-symbol. Got %s, Expected %s",
+			wtype_name(WTYPE(a->cell[0]->cell[i])), wtype_name(WVAL_SYM));
+	}
+	
+	wval* formals =  wval_pop(a, 0);
+	wval* body = wval_pop(a, 0);
+	wval_del(a);
+
+	return wval_lambda(e, formals, body);
+} 
+
+int word_gt(long x, long y) { return x >  y; }
+int word_lt(long x, long y) { return x <  y; }
+int word_ge(long x, long y) { return x >= y; }
+int word_le(long x, long y) { return x <= y; }
+
+wval* builtin_ord(wenv* e, wval* a, char* op, int (*ord)(long, long))
+{
+	WASSERT_NUM(op, a, 2);
+	WASSERT_TYPE(op, a, 0, WVAL_NUM);
+	WASSERT_TYPE(op, a, 1, WVAL_NUM);
+
+	int r = ord(WNUM(a->cell[0]), WNUM(a->cell[1]));
+	wval_del(a);
+	return wval_num(r);
+}
+
+wval* builtin_gt(wenv* e, wval* a) { return builtin_ord(e, a, ">",  word_gt); }
+wval* builtin_lt(wenv* e, wval* a) { return builtin_ord(e, a, "<",  word_lt); }
+wval* builtin_ge(wenv* e, wval* a) { return builtin_ord(e, a, ">=", word_ge); }
+wval* builtin_le(wenv* e, wval* a) { return builtin_ord(e, a, "<=", word_le); }
+
+wval* builtin_cmp(wenv* e, wval* a, char* op, int neq)
+{
+	WASSERT_NUM(op, a, 2);
+	int r = wval_eq(a->cell[0], a->cell[1]) != neq;
+	wval_del(a);
+	return wval_num(r);
+}
+
+wval* builtin_eq(wenv* e, wval* a) { return builtin_cmp(e, a, "==", 0); }
+wval* builtin_ne(wenv* e, wval* a) { return builtin_cmp(e, a, "!=", 1); }
+
+/* Checks the arguments to `if` and returns the branch to evaluate */
+wval* builtin_if_branch(wval* a)
+{
+	WASSERT_NUM("if",  a, 3);
+	WASSERT_TYPE("if", a, 0, WVAL_NUM);
+	WASSERT_TYPE("if", a, 1, WVAL_QEXPR);
+	WASSERT_TYPE("if", a, 2, WVAL_QEXPR);
+
+	wval* x = wval_pop(a, WNUM(a->cell[0]) ? 1 : 2);
+	x->type = WVAL_SEXPR;
+	
+	wval_del(a);
+	return x;
+}
+
+wval* builtin_if(wenv* e, wval* a)
+{
+	return wval_eval(e, builtin_if_branch(a));
+}
+
+wval* wread_src(char* src);
+
+/* The text of a source file, and how it was read */
+typedef struct
+{
+	char* src;
+	size_t len;
+	size_t mapped;
+	int regular;
+} wsrc;
+
+int wsrc_open(wsrc* f, char* path);
+void wsrc_close(wsrc* f);
+
+wval* wcache_load(char* path, wsrc* f, unsigned long hash);
+void wcache_save(char* path, wsrc* f, unsigned long hash, wval* expr);
+
+/* Evaluates each of the forms in expr in turn, printing any errors */
+void wval_eval_each(wenv* e, wval* expr)
+{
+	for (int i = 0; i < expr->count; i++)
+	{
+		wval* x = expr->cell[i];
+		expr->cell[i] = NULL;
+		warena_begin();
+		x = wval_eval(e, x);
+		if (WTYPE(x) == WVAL_ERR) { wval_println(x); }
+		wval_del(x);
+		warena_end();
+	}
+	wval_del(expr);
+}
+
+wval* builtin_load(wenv* e, wval* a)
+{
+	WASSERT_NUM("load", a, 1);
+	WASSERT_TYPE("load", a, 0, WVAL_STR);
+
+	/* Text read before, whatever its path, is taken from its cache */
+	wsrc f;
+	int opened = wsrc_open(&f, a->cell[0]->str);
+	unsigned long hash = opened && f.regular ? whash_mem(f.src, f.len) : 0;
+	wval* expr = hash ? wcache_load(a->cell[0]->str, &f, hash) : NULL;
+	int cached = expr != NULL;
+
+	/* The reader stops at a '\0', so text holding one is left to mpc */
+	if (!expr && opened && strlen(f.src) == f.len) { expr = wread_src(f.src); }
+
+	/* Parsing from memory lets mpc backtrack without seeking the file */
+	mpc_result_t r;
+	if (!opened)
+	{
+		wval* err = wval_err(
+			"Could not load Library %s: error: Unable to open file!\n",
+			a->cell[0]->str);
+		wval_del(a);
+		return err;
+	}
+	if (!expr && mpc_parse(a->cell[0]->str, f.src, wgrammar(), &r)) {
+		expr = r.output;
+	}
+	if (expr && hash && !cached) { wcache_save(a->cell[0]->str, &f, hash, expr); }
+	wsrc_close(&f);
+
+	if (expr)
+	{
+		wval_eval_each(e, expr);
+		wval_del(a);
+		
+		return wval_unit();
+	}
+	else
+	{
+		char* err_msg = mpc_err_string(r.error);
+		mpc_err_delete(r.error);
+
+		wval* err = wval_err("Could not load Library %s", err_msg);
+		free(err_msg);
+		wval_del(a);
+	
+		return err;
+	}
+}
+
+wval* builtin_print(wenv* e, wval* a)
+{
+	for (int i = 0; i < a->count; i++) {
+		wval_print(a->cell[i]); putchar(' ');
+	}
+	putchar('\n');
+	wval_del(a);
+
+	return wval_unit();
+}
+
+wval* builtin_gc_stats(wenv* e, wval* a)
+{
+	printf("collections: %li\n", wheap.collections);
+	printf("minor:       %li\n", wheap.minors);
+	printf("reclaimed:   %li\n", wheap.reclaimed);
+	printf("pause total: %.3f ms\n", wheap.pause_total * 1000);
+	printf("pause max:   %.3f ms\n", wheap.pause_max * 1000);
+	printf("live bytes:  %lu\n", (unsigned long)wheap.live);
+	printf("threshold:   %lu\n", (unsigned long)wheap.threshold);
+	printf("nursery:     %li resets, %li promotions\n",
+		wnursery.resets, wnursery.promotions);
+	printf("arena:       %li rewinds, %li retired, %i pinned\n",
+		warena.rewinds, warena.retired, warena.pinned);
+	wval_del(a);
+
+	return wval_unit();
+}
+
+wval* builtin_error(wenv* e, wval* a)
+{
+	WASSERT_NUM("error", a, 1);
+	WASSERT_TYPE("error", a, 0, WVAL_STR);
+
+	wval* err = wval_err(a->cell[0]->str);
+	
+	wval_del(a);
+	return err;
+}
+
+void wenv_add_builtin(wenv* e, char* name, wbuiltin func)
+{
+	wval* k = wval_sym(name);
+	wval* v = wval_builtin(func);
+	wenv_put(e, k, v);
+	wval_del(k);
+	wval_del(v);
+}
+
+void wenv_add_builtins(wenv* e)
+{
+	/* Variable functions */
+	wenv_add_builtin(e, "def", builtin_def);
+	wenv_add_builtin(e, "=",   builtin_put);
+	wenv_add_builtin(e, "\\",  builtin_lambda);
+
+	/* List functions */
+	wenv_add_builtin(e, "list", builtin_list);
+	wenv_add_builtin(e, "head", builtin_head);
+	wenv_add_builtin(e, "tail", builtin_tail);
+	wenv_add_builtin(e, "eval", builtin_eval);
+	wenv_add_builtin(e, "join", builtin_join);
+	
+	/* Math functions */
+	wenv_add_builtin(e, "+", builtin_add);
+	wenv_add_builtin(e, "-", builtin_sub);
+	wenv_add_builtin(e, "*", builtin_mul);
+	wenv_add_builtin(e, "/", builtin_div);
+	
+	/* Comparison functions */
+	wenv_add_builtin(e, "if", builtin_if);
+	wenv_add_builtin(e, "==", builtin_eq);
+	wenv_add_builtin(e, "!=", builtin_ne);
+	wenv_add_builtin(e, ">",  builtin_gt);
+	wenv_add_builtin(e, "<",  builtin_lt);
+	wenv_add_builtin(e, ">=", builtin_ge);
+	wenv_add_builtin(e, "<=", builtin_le);
+	
+	/* String functions */
+	wenv_add_builtin(e, "load",  builtin_load);
+	wenv_add_builtin(e, "error", builtin_error);
+	wenv_add_builtin(e, "print", builtin_print);
+
+	/* System functions */
+	wenv_add_builtin(e, "gc-stats", builtin_gc_stats);
+}
+
+/* Evaluation */
+
+/*
+ * Binds the arguments in a, after any f has already been given, to the
+ * formals of lambda f in a new frame that f->env becomes the parent of.
+ * Returns NULL once every formal is bound and the body is ready to run in
+ * f->env, otherwise the result of the call: a partially applied copy of
+ * f holding the arguments so far, or an error.
+ */
+wval* wval_bind(wval* f, wval* a)
+{
+	int given = a->count;
+	int total = f->formals->count;
+	int left = total;
+	if (f->args)
+	{
+		left -= f->args->count;
+		a = wval_join(f->args, a);
+		f->args = NULL;
+	}
+
+	/* Nothing is bound until the formals before any '&' are all given */
+	int fixed = 0;
+	while (fixed < total && WNAME(f->formals->cell[fixed]) != wsym_amp) {
+		fixed++;
+	}
+	if (a->count < fixed)
+	{
+		f->args = a;
+		return wval_copy(f);
+	}
+
+	wenv* frame = wenv_new();
+	frame->par = f->env;
+	f->env = frame;
+	wval_unshare(a);
+
+	/* Walks formals and arguments by index */
+	int k = 0;
+	for (int i = 0; i < a->count; i++)
+	{
+		if (k == total)
+		{
+			wval_del(a); 
+			return wval_err(
+				"Function passed too many arguments. "
+				"Got %i, Expected %i.", given, left);
+		}
+		
+		char* sym = WNAME(f->formals->cell[k++]);
+		
+		if (sym == wsym_amp)
+		{
+			if (total - k != 1)
+			{
+				wval_del(a);
+				return wval_err("Function format invalid. "
+					"Symbol '&' not followed by single symbol.");
+			}
+			
+			wval* rest = wval_slice(a, i);
+			rest->type = WVAL_QEXPR;
+			wenv_bind(frame, WNAME(f->formals->cell[k++]), rest);
+			break;
+		}
+		
+		wenv_bind(frame, sym, a->cell[i]);
+		a->cell[i] = NULL;
+	}
+
+	wval_del(a);
+
+	/* All that can be left is '&' with nothing given for it */
+	if (k < total)
+	{
+		if (total - k != 2) {
+			return wval_err("Function format invalid. "
+				"Symbol '&' not followed by single symbol.");
+		}
+		wenv_bind(frame, WNAME(f->formals->cell[k+1]), wval_qexpr());
+	}
+
+	return NULL;
+}
+
+wval* wvm_run(wcode* c, wenv* env);
+
+/*
+ * Forms in tail position (the result of a lambda body, the chosen branch
+ * of `if`, the expression given to `eval`) replace v and loop rather than
+ * recursing, so iteration written as tail recursion runs in constant C
+ * stack.
+ */
+wval* wval_eval(wenv* e, wval* v)
+{
+	/* Env of the lambda body being run, owned by this loop */
+	wenv* frame = NULL;
+
+	while (WTYPE(v) == WVAL_SYM || WTYPE(v) == WVAL_SEXPR)
+	{
+		wgc_poll();
+
+		if (WTYPE(v) == WVAL_SYM)
+		{
+			wval* x = wenv_get(e, v);
+			wval_del(v);
+			v = x;
+			break;
+		}
+
+		wval_unshare(v);
+		for (int i = 0; i < v->count; i++)
+		{
+			/* Detach the cell so the collector never sees it half-evaluated */
+			wval* x = v->cell[i];
+			v->cell[i] = NULL;
+			v->cell[i] = wval_eval(e, x);
+		}
+		int err = -1;
+		for (int i = 0; i < v->count && err < 0; i++) {
+			if (WTYPE(v->cell[i]) == WVAL_ERR) { err = i; }
+		}
+		if (err >= 0)
+		{
+			v = wval_take(v, err);
+			break;
+		}
+
+		if (v->count == 0) { break; }
+		if (v->count == 1)
+		{
+			v = wval_take(v, 0);
+			continue;
+		}
+	
+		wval* f = wval_pop(v, 0);
+		if (WTYPE(f) != WVAL_FUN)
+		{
+			wval* err = wval_err(
+				"S-Expression starts with incorrect type. "
+				"Got %s, Expected %s.",
+				wtype_name(WTYPE(f)), wtype_name(WVAL_FUN));
+			wval_del(f);
+			wval_del(v);
+			v = err;
+			break;
+		}
+
+		if (f->builtin == builtin_if || f->builtin == builtin_eval)
+		{
+			v = f->builtin == builtin_if ?
+				builtin_if_branch(v) : builtin_eval_expr(v);
+			wval_del(f);
+			continue;
+		}
+
+		if (f->builtin)
+		{
+			wval* x = f->builtin(e, v);
+			wval_del(f);
+			v = x;
+			break;
+		}
+
+		wval* x = wval_bind(f, v);
+		if (x)
+		{
+			wval_del(f);
+			v = x;
+			break;
+		}
+
+		/* The caller's frame is not in the callee's scope, so a tail call drops it */
+		wenv* callee = wenv_share(f->env);
+		if (frame) { wenv_del(frame); }
+		e = frame = callee;
+
+		if (f->code)
+		{
+			v = wvm_run(f->code, frame);
+			wval_del(f);
+			break;
+		}
+
+		v = wval_copy(f->body);
+		v->type = WVAL_SEXPR;
+		wval_del(f);
+	}
+
+	if (frame) { wenv_del(frame); }
+	return v;
+}
+
+/* Bytecode */
+
+/*
+ * Lambda bodies are compiled when the lambda is made, to code for a small
+ * stack machine. Formals are read straight from the slot they land on in
+ * a freshly bound frame and every other symbol is looked up by name as
+ * before. Calls between compiled lambdas push a VM frame instead of
+ * recursing in C. `if` with literal branches compiles to a jump, taken
+ * while `if` is still bound to the builtin, with a plain call after it
+ * for when it is not.
+ */
+
+enum { WOP_CONST, WOP_LOCAL, WOP_GLOBAL, WOP_CALL, WOP_TAIL_CALL,
+       WOP_CHECK_IF, WOP_JUMP_IF_FALSE, WOP_JUMP, WOP_RETURN };
+
+/*
+ * Code is a heap container, since its constants can hold closures whose
+ * env refers back to the lambda. The link comes first so a function's
+ * code pointer can be visited as one.
+ */
+struct wcode
+{
+	wgc gc;
+	int count;
+	int cap;
+	int* ops;
+	int nconsts;
+	int constcap;
+	wval** consts;
+
+	/* Formals other than '&' and where each is bound in a fresh frame */
+	int nformals;
+	int variadic;
+	char** formals;
+	int* slots;
+	int frame;
+};
+
+wcode* wcode_share(wcode* c)
+{
+	c->gc.refs++;
+	return c;
+}
+
+void wcode_traverse(wcode* c, wgc_visit visit)
+{
+	for (int i = 0; i < c->nconsts; i++) {
+		if (c->consts[i]) { wgc_traverse_val(c->consts[i], visit); }
+	}
+}
+
+/* Drops the constants of code found to be garbage, breaking its cycles */
+void wcode_clear(wcode* c)
+{
+	for (int i = 0; i < c->nconsts; i++)
+	{
+		if (c->consts[i]) { wval_del(c->consts[i]); }
+		c->consts[i] = NULL;
+	}
+}
+
+void wcode_del(wcode* c)
+{
+	if (!c || --c->gc.refs > 0) { return; }
+
+	wheap_untrack(&c->gc);
+	for (int i = 0; i < c->nconsts; i++) {
+		if (c->consts[i]) { wval_del(c->consts[i]); }
+	}
+	wheap_free(c->consts, sizeof(wval*) * c->constcap);
+	wheap_free(c->ops, sizeof(int) * c->cap);
+	wheap_free(c->formals, sizeof(char*) * c->nformals);
+	wheap_free(c->slots, sizeof(int) * c->nformals);
+	wheap_free(c, sizeof(wcode));
+}
+
+void wcode_emit(wcode* c, int op)
+{
+	if (c->count == c->cap)
+	{
+		int cap = c->cap ? c->cap * 2 : 16;
+		c->ops = wheap_realloc(c->ops, sizeof(int) * c->cap, sizeof(int) * cap);
+		c->cap = cap;
+	}
+	c->ops[c->count++] = op;
+}
+
+int wcode_const(wcode* c, wval* v)
+{
+	if (c->nconsts == c->constcap)
+	{
+		int cap = c->constcap ? c->constcap * 2 : 4;
+		c->consts = wheap_realloc(c->consts,
+			sizeof(wval*) * c->constcap, sizeof(wval*) * cap);
+		c->constcap = cap;
+	}
+	c->consts[c->nconsts] = wval_copy(v);
+	return c->nconsts++;
+}
+
+int wcode_formal(wcode* c, char* sym)
+{
+	for (int i = 0; i < c->nformals; i++) {
+		if (c->formals[i] == sym) { return i; }
+	}
+	return -1;
+}
+
+void wcode_compile_sexpr(wcode* c, wval* v, int tail);
+
+void wcode_compile_expr(wcode* c, wval* x, int tail)
+{
+	switch (WTYPE(x))
+	{
+		case WVAL_SYM:
+		{
+			int i = wcode_formal(c, WNAME(x));
+			if (i >= 0)
+			{
+				wcode_emit(c, WOP_LOCAL);
+				wcode_emit(c, i);
+				break;
+			}
+			/* Followed by the global's cached slot */
+			wcode_emit(c, WOP_GLOBAL);
+			wcode_emit(c, wcode_const(c, x));
+			wcode_emit(c, -1);
+			break;
+		}
+		case WVAL_SEXPR: wcode_compile_sexpr(c, x, tail); break;
+		default:
+			wcode_emit(c, WOP_CONST);
+			wcode_emit(c, wcode_const(c, x));
+			break;
+	}
+}
+
+/* Compiles the cells of v as an S-Expression, whatever its type */
+void wcode_compile_sexpr(wcode* c, wval* v, int tail)
+{
+	if (v->count == 0)
+	{
+		wcode_emit(c, WOP_CONST);
+		wcode_emit(c, wcode_const(c, wval_unit()));
+		return;
+	}
+
+	if (v->count == 1)
+	{
+		wcode_compile_expr(c, v->cell[0], tail);
+		return;
+	}
+
+	wval** x = v->cell;
+	if (v->count == 4 && WTYPE(x[0]) == WVAL_SYM && WNAME(x[0]) == wsym_if &&
+		wcode_formal(c, wsym_if) < 0 &&
+		WTYPE(x[2]) == WVAL_QEXPR && WTYPE(x[3]) == WVAL_QEXPR)
+	{
+		/* Jumps to the call below unless `if` is the builtin, followed by its cached slot */
+		wcode_emit(c, WOP_CHECK_IF);
+		wcode_emit(c, -1);
+		int check = c->count;
+		wcode_emit(c, 0);
+
+		/* Jumps to the else branch, or to the end with an error */
+		wcode_compile_expr(c, x[1], 0);
+		wcode_emit(c, WOP_JUMP_IF_FALSE);
+		int cond = c->count;
+		wcode_emit(c, 0);
+		wcode_emit(c, 0);
+
+		wcode_compile_sexpr(c, x[2], tail);
+		wcode_emit(c, WOP_JUMP);
+		int then = c->count;
+		wcode_emit(c, 0);
+
+		c->ops[cond] = c->count;
+		wcode_compile_sexpr(c, x[3], tail);
+		wcode_emit(c, WOP_JUMP);
+		int other = c->count;
+		wcode_emit(c, 0);
+
+		c->ops[check] = c->count;
+		for (int i = 0; i < v->count; i++) {
+			wcode_compile_expr(c, x[i], 0);
+		}
+		wcode_emit(c, tail ? WOP_TAIL_CALL : WOP_CALL);
+		wcode_emit(c, v->count-1);
+
+		c->ops[cond+1] = c->ops[then] = c->ops[other] = c->count;
+		return;
+	}
+
+	for (int i = 0; i < v->count; i++) {
+		wcode_compile_expr(c, x[i], 0);
+	}
+	wcode_emit(c, tail ? WOP_TAIL_CALL : WOP_CALL);
+	wcode_emit(c, v->count-1);
+}
+
+/*
+ * Returns NULL for a malformed '&', which the tree-walker reports on
+ * call, and for repeated formals, which cannot each have a slot.
+ */
+wcode* wcode_compile(wval* formals, wval* body)
+{
+	int n = formals->count;
+	int variadic = 0;
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = 0; j < i; j++) {
+			if (WNAME(formals->cell[j]) == WNAME(formals->cell[i])) { return NULL; }
+		}
+		if (WNAME(formals->cell[i]) != wsym_amp) { continue; }
+		if (i != n-2) { return NULL; }
+		variadic = 1;
+	}
+
+	wcode* c = wheap_alloc(sizeof(wcode));
+	wheap_track(&c->gc, WGC_CODE);
+	c->count = c->cap = 0;
+	c->ops = NULL;
+	c->nconsts = c->constcap = 0;
+	c->consts = NULL;
+	c->nformals = n - variadic;
+	c->variadic = variadic;
+	c->formals = wheap_alloc(sizeof(char*) * c->nformals);
+	c->slots = wheap_alloc(sizeof(int) * c->nformals);
+
+	for (int i = 0, j = 0; i < n; i++) {
+		if (WNAME(formals->cell[i]) != wsym_amp) {
+			c->formals[j++] = WNAME(formals->cell[i]);
+		}
+	}
+
+	/* Binding into a scratch frame in call order shows where each lands */
+	wenv* e = wenv_new();
+	for (int i = 0; i < c->nformals; i++) {
+		wenv_bind(e, c->formals[i], wval_unit());
+	}
+	for (int i = 0; i < c->nformals; i++) {
+		c->slots[i] = wenv_find(e, c->formals[i]);
+	}
+	c->frame = e->cap;
+	wenv_del(e);
+
+	wcode_compile_sexpr(c, body, 1);
+	wcode_emit(c, WOP_RETURN);
+	return c;
+}
+
+/* Virtual Machine */
+
+typedef struct
+{
+	wcode* code;
+	int pc;
+	wenv* env;
+} wframe;
+
+struct
+{
+	int sp;
+	int cap;
+	wval** stack;
+	int fp;
+	int fcap;
+	wframe* frames;
+} wvm;
+
+void wvm_push(wval* x)
+{
+	if (wvm.sp == wvm.cap)
+	{
+		wvm.cap = wvm.cap ? wvm.cap * 2 : 256;
+		wvm.stack = realloc(wvm.stack, sizeof(wval*) * wvm.cap);
+	}
+	wvm.stack[wvm.sp++] = x;
+}
+
+/* Pops n values, skipping any already taken */
+void wvm_drop(int n)
+{
+	while (n--)
+	{
+		wval* x = wvm.stack[--wvm.sp];
+		if (x) { wval_del(x); }
+	}
+}
+
+/* Moves n values off the stack into a new list */
+wval* wvm_list(wval** a, int n, int type)
+{
+	wval* x = type == WVAL_QEXPR ? wval_qexpr() : wval_sexpr();
+	if (n == 0) { return x; }
+
+	wval_cells_resize(x, n);
+	memcpy(x->cell, a, sizeof(wval*) * n);
+	x->count = n;
+	return x;
+}
+
+/* Takes ownership of env */
+void wvm_enter(wcode* c, wenv* env)
+{
+	if (wvm.fp == wvm.fcap)
+	{
+		wvm.fcap = wvm.fcap ? wvm.fcap * 2 : 64;
+		wvm.frames = realloc(wvm.frames, sizeof(wframe) * wvm.fcap);
+	}
+	wframe* fr = &wvm.frames[wvm.fp++];
+	fr->code = wcode_share(c);
+	fr->pc = 0;
+	fr->env = env;
+}
+
+void wvm_leave(void)
+{
+	wframe* fr = &wvm.frames[--wvm.fp];
+	wenv_del(fr->env);
+	wcode_del(fr->code);
+}
+
+/* Runs a compiled callee in a new frame, or in place of the current one */
+void wvm_enter_call(wcode* c, wenv* callee, int tail)
+{
+	wframe* fr = &wvm.frames[wvm.fp-1];
+	if (!tail)
+	{
+		wvm_enter(c, callee);
+		return;
+	}
+
+	wenv_del(fr->env);
+	fr->env = callee;
+
+	wcode_share(c);
+	wcode_del(fr->code);
+	fr->code = c;
+	fr->pc = 0;
+}
+
+/*
+ * Calls the function under n arguments on top of the stack, with the
+ * same checks as the tree-walker. Returns the result, or NULL once a
+ * compiled callee has been entered.
+ */
+wval* wvm_call(int n, int tail)
+{
+	wval** a = &wvm.stack[wvm.sp-n-1];
+	wval* f = a[0];
+	wenv* e = wvm.frames[wvm.fp-1].env;
+
+	for (int i = 0; i <= n; i++)
+	{
+		if (WTYPE(a[i]) == WVAL_ERR)
+		{
+			wval* err = a[i];
+			a[i] = NULL;
+			wvm_drop(n+1);
+			return err;
+		}
+	}
+
+	if (WTYPE(f) != WVAL_FUN)
+	{
+		wval* err = wval_err(
+			"S-Expression starts with incorrect type. "
+			"Got %s, Expected %s.",
+			wtype_name(WTYPE(f)), wtype_name(WVAL_FUN));
+		wvm_drop(n+1);
+		return err;
+	}
+
+	wval* args = NULL;
+	if (f->builtin == builtin_if || f->builtin == builtin_eval)
+	{
+		/* The form is compiled to run in the caller's env, rather than recursing in C */
+		args = wvm_list(a+1, n, WVAL_SEXPR);
+		wvm.sp -= n+1;
+		wval* x = f->builtin == builtin_if ?
+			builtin_if_branch(args) : builtin_eval_expr(args);
+		wval_del(f);
+		if (WTYPE(x) == WVAL_ERR) { return x; }
+
+		wcode* c = wcode_compile(wval_unit(), x);
+		wval_del(x);
+		wvm_enter_call(c, wenv_share(e), tail);
+		wcode_del(c);
+		return NULL;
+	}
+
+	if (f->builtin)
+	{
+		args = wvm_list(a+1, n, WVAL_SEXPR);
+		wvm.sp -= n+1;
+		wval* x = f->builtin(e, args);
+		wval_del(f);
+		return x;
+	}
+
+	/*
+	 * A compiled lambda given the rest of its arguments is bound directly,
+	 * with those of a partial application first. Those all go to formals
+	 * before any '&', since binding waits for the last of them.
+	 */
+	wcode* c = f->code;
+	int m = f->args ? f->args->count : 0;
+	if (c && (c->variadic ? m+n >= c->nformals-1 : m+n == c->nformals))
+	{
+		wenv* callee = wenv_frame(c->frame);
+		callee->par = wenv_share(f->env);
+		int fixed = c->nformals - c->variadic;
+		for (int i = 0; i < fixed; i++)
+		{
+			wval* x = i < m ? wval_copy(f->args->cell[i]) : a[i+1-m];
+			wenv_bind_at(callee, c->slots[i], c->formals[i], x);
+		}
+		if (c->variadic)
+		{
+			wenv_bind_at(callee, c->slots[fixed], c->formals[fixed],
+				wvm_list(a+1+fixed-m, m+n-fixed, WVAL_QEXPR));
+		}
+		wvm.sp -= n+1;
+
+		wvm_enter_call(c, callee, tail);
+		wval_del(f);
+		return NULL;
+	}
+
+	args = wvm_list(a+1, n, WVAL_SEXPR);
+	wvm.sp -= n+1;
+
+	wval* x = wval_bind(f, args);
+	if (x)
+	{
+		wval_del(f);
+		return x;
+	}
+
+	wenv* callee = wenv_share(f->env);
+	if (c)
+	{
+		wvm_enter_call(c, callee, tail);
+		wval_del(f);
+		return NULL;
+	}
+
+	x = wval_copy(f->body);
+	x->type = WVAL_SEXPR;
+	x = wval_eval(callee, x);
+	wenv_del(callee);
+	wval_del(f);
+	return x;
+}
+
+/* Runs c in env until it returns, sharing the stacks with any outer run */
+wval* wvm_run(wcode* c, wenv* env)
+{
+	int base = wvm.fp;
+	wvm_enter(c, wenv_share(env));
+
+	while (1)
+	{
+		wframe* fr = &wvm.frames[wvm.fp-1];
+		c = fr->code;
+		int op = c->ops[fr->pc++];
+
+		switch (op)
 		{
-			wval_del(e->vals[i]);
-			e->vals[i] = wval_copy(v);
-			return;
+			case WOP_CONST:
+				wvm_push(wval_copy(c->consts[c->ops[fr->pc++]]));
+				break;
+
+			case WOP_LOCAL:
+			{
+				/* Falls back to lookup if the frame has since been rehashed */
+				int i = c->ops[fr->pc++];
+				int s = c->slots[i];
+				wenv* e = fr->env;
+				if (s < e->cap && e->binds[s].sym == c->formals[i]) {
+					wvm_push(wval_copy(e->binds[s].val));
+				} else {
+					wvm_push(wenv_lookup(e, c->formals[i]));
+				}
+				break;
+			}
+
+			case WOP_GLOBAL:
+			{
+				wval* k = c->consts[c->ops[fr->pc]];
+				int* s = &c->ops[fr->pc+1];
+				fr->pc += 2;
+
+				/* Unless some frame binds it, the name can only be a global */
+				wenv* g = wenv_root;
+				if (WSYM(WNAME(k))->locals == 0)
+				{
+					if (*s < 0 || *s >= g->cap || g->binds[*s].sym != WNAME(k)) {
+						*s = wenv_find(g, WNAME(k));
+					}
+					if (*s >= 0)
+					{
+						wvm_push(wval_copy(g->binds[*s].val));
+						break;
+					}
+				}
+				wvm_push(wenv_get(fr->env, k));
+				break;
+			}
+
+			case WOP_CALL:
+			case WOP_TAIL_CALL:
+			{
+				wgc_poll();
+				wval* x = wvm_call(c->ops[fr->pc++], op == WOP_TAIL_CALL);
+				if (x) { wvm_push(x); }
+				break;
+			}
+
+			case WOP_CHECK_IF:
+			{
+				int* s = &c->ops[fr->pc];
+				int to = c->ops[fr->pc+1];
+				fr->pc += 2;
+
+				/* A binding of `if` in any frame leaves it to the call */
+				wenv* g = wenv_root;
+				if (WSYM(wsym_if)->locals == 0 &&
+					(*s < 0 || *s >= g->cap || g->binds[*s].sym != wsym_if)) {
+					*s = wenv_find(g, wsym_if);
+				}
+				if (WSYM(wsym_if)->locals != 0 || *s < 0 ||
+					WTYPE(g->binds[*s].val) != WVAL_FUN ||
+					g->binds[*s].val->builtin != builtin_if) {
+					fr->pc = to;
+				}
+				break;
+			}
+
+			case WOP_JUMP_IF_FALSE:
+			{
+				wval* x = wvm.stack[wvm.sp-1];
+				int to = c->ops[fr->pc];
+				int end = c->ops[fr->pc+1];
+				fr->pc += 2;
+
+				/* An error is the value of the whole `if` */
+				if (WTYPE(x) == WVAL_ERR)
+				{
+					fr->pc = end;
+					break;
+				}
+				if (WTYPE(x) != WVAL_NUM)
+				{
+					wvm.stack[wvm.sp-1] = wval_err(
+						"Function '%s' passed incorrect type for argument %i. "
+						"Got %s, Expected %s",
+						"if", 0, wtype_name(WTYPE(x)), wtype_name(WVAL_NUM));
+					wval_del(x);
+					fr->pc = end;
+					break;
+				}
+
+				if (!WNUM(x)) { fr->pc = to; }
+				wvm_drop(1);
+				break;
+			}
+
+			case WOP_JUMP:
+				fr->pc = c->ops[fr->pc];
+				break;
+
+			case WOP_RETURN:
+			{
+				wval* x = wvm.stack[--wvm.sp];
+				wvm_leave();
+				if (wvm.fp == base) { return x; }
+				wvm_push(x);
+				break;
+			}
 		}
 	}
-	
-	e->count++;
-	e->vals = realloc(e->vals, sizeof(wval*) * e->count);
-	e->syms = realloc(e->syms, sizeof(char*) * e->count);
+}
 
-	e->vals[e->count-1] = wval_copy(v);
-	e->syms[e->count-1] = malloc(strlen(k->sym)+1);
-	strcpy(e->syms[e->count-1], k->sym);
+void wvm_cleanup(void)
+{
+	free(wvm.stack);
+	free(wvm.frames);
+	wvm.stack = NULL;
+	wvm.frames = NULL;
+	wvm.sp = wvm.cap = wvm.fp = wvm.fcap = 0;
 }
 
-/* For variable definition in global env */
-void wenv_def(wenv* e, wval* k, wval* v)
+/* Reading */
+
+/*
+ * The mpc grammar from wgrammar builds values as it parses, through
+ * these callbacks, rather than leaving a tree of tagged AST nodes to walk.
+ * Each gets the text a token matched, which it owns.
+ */
+
+mpc_val_t* wval_read_num(mpc_val_t* x)
 {
-	while (e->par) { e = e->par; }
-	wenv_put(e, k, v);
+	errno = 0;
+	long n = strtol(x, NULL, 10);
+	wval* v = errno != ERANGE ? wval_num(n) : &wconst[WCONST_BAD_NUM];
+	free(x);
+	return v;
 }
 
-/* Builtins */
+mpc_val_t* wval_read_sym(mpc_val_t* x)
+{
+	wval* v = wval_sym(x);
+	free(x);
+	return v;
+}
 
-#define WASSERT(args, cond, fmt, ...) \
-	if (!(cond)) { \
-		wval* err = wval_err(fmt, ##__VA_ARGS__); \
-		wval_del(args); \
-		return err; \
+/* Unescapes between the quotes in place of a second copy */
+mpc_val_t* wval_read_str(mpc_val_t* x)
+{
+	char* s = x;
+	size_t n = strlen(s);
+	memmove(s, s+1, n-2);
+	s[n-2] = '\0';
+	s = mpcf_unescape(s);
+	wval* v = wval_str(s);
+	free(s);
+	return v;
+}
+
+/* Comments read as NULL, which the folds below leave out */
+mpc_val_t* wval_read_skip(mpc_val_t* x)
+{
+	free(x);
+	return NULL;
+}
+
+void wval_read_del(mpc_val_t* x)
+{
+	if (x) { wval_del(x); }
+}
+
+mpc_val_t* wval_read_exprs(int n, mpc_val_t** xs)
+{
+	wval* x = wval_sexpr();
+	if (n == 0) { return x; }
+
+	/* Read values tend to live long, so the cells are sized exactly */
+	wval_cells_resize(x, n);
+	for (int i = 0; i < n; i++) {
+		if (xs[i]) { x->cell[x->count++] = xs[i]; }
 	}
+	if (x->count < n) { wval_cells_resize(x, x->count); }
+	return x;
+}
 
-#define WASSERT_TYPE(func, args, index, expect) \
-	WASSERT(args, args->cell[index]->type == expect, \
-		"Function '%s' passed incorrect type for argument %i. Got %s, Expected %s", \
-		func, index, wtype_name(args->cell[index]->type), wtype_name(expect))
+/* Keeps the middle of a bracketed list, or of the whole input */
+mpc_val_t* wval_read_sexpr(int n, mpc_val_t** xs)
+{
+	free(xs[0]);
+	free(xs[2]);
+	return xs[1];
+}
 
-#define WASSERT_NUM(func, args, num) \
-	WASSERT(args, args->count == num, \
-		"Funcion '%s' passed incorrect number of arguments. Got %i, Expected %i.", \
-		func, args->count, num)
+mpc_val_t* wval_read_qexpr(int n, mpc_val_t** xs)
+{
+	wval* x = wval_read_sexpr(n, xs);
+	x->type = WVAL_QEXPR;
+	return x;
+}
 
-#define WASSERT_NOT_EMPTY(func, args, index) \
-	WASSERT(args, args->cell[index]->count != 0, \
-		"Function '%s' passed {} for argument %i.", func, index);
+/*
+ * Builds the mpc grammar the first time source needs it, which is only
+ * when the reader below rejects some or under -DWISP_MPC_READER, so a
+ * script that reads cleanly never pays for compiling its regexes.
+ */
+mpc_parser_t* wgrammar(void)
+{
+	if (Wispy) { return Wispy; }
 
-wval* wval_eval(wenv* e, wval* v);
+	Number  = mpc_new("number");
+	Symbol  = mpc_new("symbol");
+	String  = mpc_new("string");
+	Comment = mpc_new("comment");
+	Sexpr   = mpc_new("sexpr");
+	Qexpr   = mpc_new("qexpr");
+	Expr    = mpc_new("expr");
+	Wispy   = mpc_new("wispy");
 
-wval* builtin_head(wenv* e, wval* a)
+	/*
+	 * The parsers mpca_lang built from the rules
+	 *
+	 *   sexpr : '(' <expr>* ')' ;
+	 *   qexpr : '{' <expr>* '}' ;
+	 *   expr  : <number>  | <symbol> | <string>
+	 *         | <comment> | <sexpr>  | <qexpr> ;
+	 *   wispy : /^/ <expr>* /$/ ;
+	 *
+	 * and the regexes below, so errors read as they did, but with
+	 * callbacks that return values in place of AST nodes.
+	 */
+	mpc_define(Number, mpc_apply(
+		mpc_tok(mpc_re("-?[0-9]+(\\.[0-9]+)?")), wval_read_num));
+	mpc_define(Symbol, mpc_apply(
+		mpc_tok(mpc_re("[a-zA-Z0-9_+\\-*/\\\\=<>!&]+")), wval_read_sym));
+	mpc_define(String, mpc_apply(
+		mpc_tok(mpc_re("\"(\\\\.|[^\"])*\"")), wval_read_str));
+	mpc_define(Comment, mpc_apply(
+		mpc_tok(mpc_re(";[^\\r\\n]*")), wval_read_skip));
+	mpc_define(Sexpr, mpc_and(3, wval_read_sexpr,
+		mpc_tok(mpc_char('(')), mpc_many(wval_read_exprs, Expr),
+		mpc_tok(mpc_char(')')), free, wval_read_del));
+	mpc_define(Qexpr, mpc_and(3, wval_read_qexpr,
+		mpc_tok(mpc_char('{')), mpc_many(wval_read_exprs, Expr),
+		mpc_tok(mpc_char('}')), free, wval_read_del));
+	mpc_define(Expr, mpc_or(6,
+		Number, Symbol, String, Comment, Sexpr, Qexpr));
+	mpc_define(Wispy, mpc_and(3, wval_read_sexpr,
+		mpc_tok(mpc_re("^")), mpc_many(wval_read_exprs, Expr),
+		mpc_tok(mpc_re("$")), free, wval_read_del));
+
+	return Wispy;
+}
+
+void wgrammar_cleanup(void)
 {
-	WASSERT_NUM("head", a, 1);
-	WASSERT_TYPE("head", a, 0, WVAL_QEXPR);
-	WASSERT_NOT_EMPTY("head", a, 0);
-	
-	wval* v = wval_take(a, 0);
-	while (v->count > 1) { wval_del(wval_pop(v, 1)); }
-	return v;
+	if (!Wispy) { return; }
+	mpc_cleanup(8,
+		Number, Symbol, String, Comment, 
+		Sexpr,  Qexpr,  Expr,   Wispy);
+	Wispy = NULL;
 }
 
-wval* builtin_tail(wenv* e, wval* a)
+/*
+ * Reads source text straight into values, accepting exactly what the mpc
+ * grammar above does. On anything else it returns NULL and the caller
+ * parses the text again with mpc, which reports the error as it always
+ * has. Building with -DWISP_MPC_READER leaves all reading to mpc.
+ */
+
+int wread_digit(char c)
 {
-	WASSERT_NUM("tail", a, 1);
-	WASSERT_TYPE("tail", a, 0, WVAL_QEXPR);
-	WASSERT_NOT_EMPTY("tail", a, 0);
+	return c >= '0' && c <= '9';
+}
 
-	wval* v = wval_take(a, 0);
-	wval_del(wval_pop(v, 0));
-	return v;
+int wread_symchar(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		wread_digit(c) || (c && strchr("_+-*/\\=<>!&", c));
 }
 
-wval* builtin_list(wenv* e, wval* a)
+/* Skips whitespace and comments, either of which may come before a token */
+void wread_space(char** s)
 {
-	a->type = WVAL_QEXPR;
-	return a;
+	while (1)
+	{
+		while (**s && strchr(" \f\n\r\t\v", **s)) { (*s)++; }
+		if (**s != ';') { return; }
+		while (**s && **s != '\r' && **s != '\n') { (*s)++; }
+	}
 }
 
-wval* builtin_join(wenv* e, wval* a)
+wval* wread_list(char** s, wval* x, char close);
+
+wval* wread_expr(char** s)
 {
-	for (int i = 0; i < a->count; i++) {
-		WASSERT_TYPE("join", a, i, WVAL_QEXPR); 
+	char* p = *s;
+
+	/* Numbers are tried first, so `-1` is a number but `-` and `-a` are symbols */
+	if (wread_digit(*p) || (*p == '-' && wread_digit(p[1])))
+	{
+		errno = 0;
+		long x = strtol(p, NULL, 10);
+		int err = errno;
+
+		if (*p == '-') { p++; }
+		while (wread_digit(*p)) { p++; }
+		if (*p == '.' && wread_digit(p[1]))
+		{
+			p++;
+			while (wread_digit(*p)) { p++; }
+		}
+		*s = p;
+		return err != ERANGE ? wval_num(x) : &wconst[WCONST_BAD_NUM];
 	}
-	
-	wval* x = wval_pop(a, 0);
-	while (a->count) {
-		x = wval_join(x, wval_pop(a, 0));
+
+	if (wread_symchar(*p))
+	{
+		while (wread_symchar(*p)) { p++; }
+		wval* x = wval_sym_n(*s, p - *s);
+		*s = p;
+		return x;
+	}
+
+	if (*p == '"')
+	{
+		/* A backslash escapes any character but a newline */
+		for (p++; *p != '"'; p += (*p == '\\' && p[1] && p[1] != '\n') ? 2 : 1) {
+			if (!*p) { return NULL; }
+		}
+
+		size_t n = p - (*s+1);
+		char* unescaped = malloc(n+1);
+		memcpy(unescaped, *s+1, n);
+		unescaped[n] = '\0';
+		unescaped = mpcf_unescape(unescaped);
+		wval* str = wval_str(unescaped);
+		free(unescaped);
+		*s = p+1;
+		return str;
+	}
+
+	if (*p == '(')
+	{
+		*s = p+1;
+		return wread_list(s, wval_sexpr(), ')');
+	}
+	if (*p == '{')
+	{
+		*s = p+1;
+		return wread_list(s, wval_qexpr(), '}');
+	}
+	return NULL;
+}
+
+/* Reads expressions into x up to close, where '\0' is the end of input */
+wval* wread_list(char** s, wval* x, char close)
+{
+	while (1)
+	{
+		wread_space(s);
+		if (**s == close) { break; }
+
+		wval* y = **s ? wread_expr(s) : NULL;
+		if (!y)
+		{
+			wval_del(x);
+			return NULL;
+		}
+		x = wval_add(x, y);
+	}
+	if (close) { (*s)++; }
+
+	if (x->cell && WCELLS(x->cell)->count > x->count) {
+		wval_cells_resize(x, x->count);
 	}
-	
-	wval_del(a);
 	return x;
 }
 
-wval* builtin_eval(wenv* e, wval* a)
+/* Reads all of src as an S-Expression, or returns NULL for mpc to retry */
+wval* wread_src(char* src)
 {
-	WASSERT_NUM("eval", a, 1);
-	WASSERT_TYPE("eval", a, 0, WVAL_QEXPR);
+#ifdef WISP_MPC_READER
+	return NULL;
+#else
+	return wread_list(&src, wval_sexpr(), '\0');
+#endif
+}
 
-	wval* x = wval_take(a, 0);
-	x->type = WVAL_SEXPR;
-	return wval_eval(e, x);
+/*
+ * Reads the file at path into f->src, ending in a '\0'. Regular files are
+ * mapped when their last page has room for that '\0', which the kernel
+ * fills with zeros; anything else, pipes included, is read into one buffer.
+ */
+int wsrc_open(wsrc* f, char* path)
+{
+	f->src = NULL;
+	f->len = 0;
+	f->mapped = 0;
+	f->regular = 0;
+
+#ifndef _WIN32
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) { return 0; }
+
+	struct stat st;
+	long page = sysconf(_SC_PAGESIZE);
+	f->regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+
+	/* A directory opens, but reading it fails, so it is refused here */
+	if (!f->regular && S_ISDIR(st.st_mode))
+	{
+		close(fd);
+		return 0;
+	}
+	if (f->regular && st.st_size > 0 && page > 0 && st.st_size % page)
+	{
+		char* p = mmap(NULL, st.st_size + 1, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED)
+		{
+			f->src = p;
+			f->len = st.st_size;
+			f->mapped = st.st_size + 1;
+		}
+	}
+	close(fd);
+	if (f->mapped) { return 1; }
+#endif
+
+	FILE* fp = fopen(path, "rb");
+	if (!fp) { return 0; }
+
+	size_t size = 4096;
+	f->src = malloc(size);
+	while (1)
+	{
+		f->len += fread(f->src + f->len, 1, size - f->len - 1, fp);
+		if (f->len < size - 1) { break; }
+		size *= 2;
+		f->src = realloc(f->src, size);
+	}
+	f->src[f->len] = '\0';
+
+	int ok = !ferror(fp);
+	fclose(fp);
+	if (!ok) { wsrc_close(f); }
+	return ok;
 }
 
-wval* builtin_op(wenv* e, wval* a, char* op)
+void wsrc_close(wsrc* f)
 {
-	for (int i = 0; i < a->count; i++) {
-		WASSERT_TYPE(op, a, i, WVAL_NUM);	
+#ifndef _WIN32
+	if (f->mapped)
+	{
+		munmap(f->src, f->mapped);
+		f->src = NULL;
+		return;
 	}
-	
-	wval* x = wval_pop(a, 0);
-	if ((strcmp(op, "-") == 0) && a->count == 0) {
-		x->num = -x->num;
-	}
-	while (a->count > 0)
-	{
-		wval* y = wval_pop(a, 0);
-		if (strcmp(op, "+") == 0) { x->num += y->num; }
-		if (strcmp(op, "-") == 0) { x->num -= y->num; }
-		if (strcmp(op, "*") == 0) { x->num *= y->num; }
-		if (strcmp(op, "%") == 0) { x->num %= y->num; }
-		if (strcmp(op, "/") == 0) { 
-			if (y->num == 0) 
+#endif
+	free(f->src);
+	f->src = NULL;
+}
+
+/* Streaming */
+
+/*
+ * Splits input into top-level forms as it is read, so a script of any
+ * size is evaluated one form at a time. Each form's text, with any space
+ * and comments before it, is read by the usual reader, and by mpc on a
+ * syntax error, then evaluated and freed before the next is read.
+ */
+typedef struct
+{
+	FILE* f;
+	char* name;
+	char* buf;
+	size_t len;
+	size_t size;
+	long row;
+	long col;
+} wstream;
+
+void wstream_putc(wstream* s, int c)
+{
+	if (s->len + 1 >= s->size)
+	{
+		s->size = s->size ? s->size * 2 : 4096;
+		s->buf = realloc(s->buf, s->size);
+	}
+	s->buf[s->len++] = c;
+	s->buf[s->len] = '\0';
+}
+
+/* Reads up to the end of the next form, returning 0 once input runs out */
+int wstream_next(wstream* s)
+{
+	int depth = 0;
+	int atom = 0;
+	int c;
+
+	s->len = 0;
+
+	while ((c = getc(s->f)) != EOF)
+	{
+		/* A number or symbol ends at the first character not in it */
+		int in_atom = wread_symchar(c) || c == '.';
+		if (atom && !depth && !in_atom)
+		{
+			ungetc(c, s->f);
+			return 1;
+		}
+		wstream_putc(s, c);
+
+		if (c == '"')
+		{
+			while ((c = getc(s->f)) != EOF && c != '"')
 			{
-				wval_del(x); wval_del(y);
-				x = wval_err("Division by zero!");
-				break;
+				wstream_putc(s, c);
+				if (c == '\\' && (c = getc(s->f)) != EOF) { wstream_putc(s, c); }
+			}
+			if (c == EOF) { break; }
+			wstream_putc(s, c);
+			if (!depth) { return 1; }
+		}
+		else if (c == ';')
+		{
+			while ((c = getc(s->f)) != EOF && c != '\r' && c != '\n') {
+				wstream_putc(s, c);
 			}
-			x->num /= y->num;
+			if (c != EOF) { ungetc(c, s->f); }
+		}
+		else if (c == '(' || c == '{')
+		{
+			depth++;
+		}
+		else if (c == ')' || c == '}')
+		{
+			if (--depth <= 0) { return 1; }
+		}
+		else if (!depth && in_atom)
+		{
+			atom = 1;
+		}
+		else if (!depth && !strchr(" \f\n\r\t\v", c))
+		{
+			/* Anything else is a form of its own, for the reader to reject */
+			return 1;
 		}
-		wval_del(y);
 	}
-	wval_del(a);
-	return x;
+	return s->len > 0;
 }
 
-wval* builtin_add(wenv* e, wval* a) { return builtin_op(e, a, "+"); }
-wval* builtin_sub(wenv* e, wval* a) { return builtin_op(e, a, "-"); }
-wval* builtin_mul(wenv* e, wval* a) { return builtin_op(e, a, "*"); }
-wval* builtin_div(wenv* e, wval* a) { return builtin_op(e, a, "/"); }
-
-wval* builtin_var(wenv* e, wval* a, char* func)
+/* Moves row and col past the form just read, the way mpc counts them */
+void wstream_advance(wstream* s)
 {
-	WASSERT_TYPE("def", a, 0, WVAL_QEXPR);
-
-	wval* syms = a->cell[0];
-	for (int i = 0; i < syms->count; i++)
+	for (size_t i = 0; i < s->len; i++)
 	{
-		WASSERT(a, (syms->cell[i]->type == WVAL_SYM),
-			"Function '%s' cannot define non-symbol! ",
-			"Got %s, Expected %s.", func,
-			wtype_name(syms->cell[i]->type), 
-			wtype_name(WVAL_SYM));
+		if (s->buf[i] == '\n') { s->row++; s->col = 0; }
+		else { s->col++; }
 	}
+}
 
-	WASSERT(a, (syms->count == a->count-1),
-		"Function '%s' passed incorrect number of arguments for symbols. "
-		"Got %i, Expected %i.",
-		func, syms->count, a->count-1);
+/* Evaluates the forms read from f one at a time, reporting errors as it goes */
+void wval_eval_stream(wenv* e, FILE* f, char* name)
+{
+	wstream s = { f, name, NULL, 0, 0, 0, 0 };
 
-	for (int i = 0; i < syms->count; i++) 
+	while (wstream_next(&s))
 	{
-		if (strcmp(func, "def") == 0) {
-			wenv_def(e, syms->cell[i], a->cell[i+1]);
+		wval* expr = strlen(s.buf) == s.len ? wread_src(s.buf) : NULL;
+
+		mpc_result_t r;
+		if (!expr && mpc_parse(s.name, s.buf, wgrammar(), &r)) {
+			expr = r.output;
 		}
 
-		if (strcmp(func, "=")   == 0) {
-			wenv_put(e, syms->cell[i], a->cell[i+1]);
+		if (expr)
+		{
+			wval_eval_each(e, expr);
+		}
+		else
+		{
+			/* mpc counts from the start of the form, not of the input */
+			if (r.error->state.row == 0) { r.error->state.col += s.col; }
+			r.error->state.row += s.row;
+			mpc_err_print(r.error);
+			mpc_err_delete(r.error);
 		}
+		wstream_advance(&s);
 	}
-
-	wval_del(a);
-	return wval_sexpr();
+	free(s.buf);
 }
 
-wval* builtin_def(wenv* e, wval* a) { return builtin_var(e, a, "def"); }
-wval* builtin_put(wenv* e, wval* a) { return builtin_var(e, a, "="); }
+/* Images */
 
-wval* builtin_lambda(wenv* e, wval* a)
+/*
+ * An image holds the globals as a stream of tagged records, written in
+ * one walk of the root env so that starting from it skips reading and
+ * evaluating the source it came from. Numbers and lengths are varints,
+ * builtins are saved by name, and each symbol and env is written once
+ * and referred to by index after, which also keeps shared and cyclic
+ * envs as they were. Images do not depend on word size or byte order.
+ */
+
+#define WIMG_MAGIC "wisp-image 1\n"
+
+/* The writer's output, and the index given to each symbol and env seen */
+typedef struct
 {
-	WASSERT_NUM("\\", a, 2);
-	WASSERT_TYPE("\\", a, 0, WVAL_QEXPR);
-	WASSERT_TYPE("\\", a, 1, WVAL_QEXPR);
+	char* buf;
+	size_t len;
+	size_t size;
+	void** keys;
+	long* ids;
+	long cap;
+	long count;
+	wenv* builtins;
+} wimg_out;
+
+void wimg_put(wimg_out* w, void* p, size_t n)
+{
+	while (w->len + n > w->size)
+	{
+		w->size = w->size ? w->size * 2 : 4096;
+		w->buf = realloc(w->buf, w->size);
+	}
+	memcpy(w->buf + w->len, p, n);
+	w->len += n;
+}
 
-	for (int i = 0; i < a->cell[0]->count; i++)
+void wimg_put_byte(wimg_out* w, int c)
+{
+	char b = c;
+	wimg_put(w, &b, 1);
+}
+
+void wimg_put_uint(wimg_out* w, unsigned long x)
+{
+	while (x >= 0x80)
 	{
-		WASSERT(a, (a->cell[0]->cell[i]->type == WVAL_SYM),
-			"Cannot define non-symbol. Got %s, Expected %s",
-			wtype_name(a->cell[0]->cell[i]->type), wtype_name(WVAL_SYM));
+		wimg_put_byte(w, (x & 0x7f) | 0x80);
+		x >>= 7;
+	}
+	wimg_put_byte(w, x);
+}
+
+/* Zigzag encodes x so small negative numbers stay short */
+void wimg_put_int(wimg_out* w, long x)
+{
+	wimg_put_uint(w, x < 0 ? ~((unsigned long)x << 1) : (unsigned long)x << 1);
+}
+
+void wimg_put_str(wimg_out* w, char* s)
+{
+	size_t n = strlen(s);
+	wimg_put_uint(w, n);
+	wimg_put(w, s, n);
+}
+
+/* Returns the index of p, or -1 after giving it the next one */
+long wimg_id(wimg_out* w, void* p)
+{
+	if ((w->count+1) * 2 > w->cap)
+	{
+		long cap = w->cap ? w->cap * 2 : 256;
+		void** keys = calloc(cap, sizeof(void*));
+		long* ids = malloc(sizeof(long) * cap);
+		for (long i = 0; i < w->cap; i++)
+		{
+			if (!w->keys[i]) { continue; }
+			unsigned long j = whash_ptr(w->keys[i]) & (cap-1);
+			while (keys[j]) { j = (j+1) & (cap-1); }
+			keys[j] = w->keys[i];
+			ids[j] = w->ids[i];
+		}
+		free(w->keys);
+		free(w->ids);
+		w->keys = keys;
+		w->ids = ids;
+		w->cap = cap;
 	}
-	
-	wval* formals =  wval_pop(a, 0);
-	wval* body = wval_pop(a, 0);
-	wval_del(a);
 
-	return wval_lambda(formals, body);
-} 
+	unsigned long i = whash_ptr(p) & (w->cap-1);
+	while (w->keys[i])
+	{
+		if (w->keys[i] == p) { return w->ids[i]; }
+		i = (i+1) & (w->cap-1);
+	}
+	w->keys[i] = p;
+	w->ids[i] = w->count++;
+	return -1;
+}
 
-wval* builtin_ord(wenv* e, wval* a, char* op)
+void wimg_put_sym(wimg_out* w, char* sym)
 {
-	WASSERT_NUM(op, a, 2);
-	WASSERT_TYPE(op, a, 0, WVAL_NUM);
-	WASSERT_TYPE(op, a, 1, WVAL_NUM);
-
-	int r;
-	if (strcmp(op, ">")  == 0) { r = (a->cell[0]->num >  a->cell[1]->num); }
-	if (strcmp(op, "<")  == 0) { r = (a->cell[0]->num <  a->cell[1]->num); }
-	if (strcmp(op, ">=") == 0) { r = (a->cell[0]->num >= a->cell[1]->num); }
-	if (strcmp(op, "<=") == 0) { r = (a->cell[0]->num <= a->cell[1]->num); }
-	wval_del(a);
-	return wval_num(r);
+	long id = wimg_id(w, sym);
+	if (id >= 0)
+	{
+		wimg_put_byte(w, 's');
+		wimg_put_uint(w, id);
+		return;
+	}
+	wimg_put_byte(w, 'S');
+	wimg_put_str(w, sym);
 }
 
-wval* builtin_gt(wenv* e, wval* a) { return builtin_ord(e, a, ">");  }
-wval* builtin_lt(wenv* e, wval* a) { return builtin_ord(e, a, "<");  }
-wval* builtin_ge(wenv* e, wval* a) { return builtin_ord(e, a, ">="); }
-wval* builtin_le(wenv* e, wval* a) { return builtin_ord(e, a, "<="); }
+void wimg_put_env(wimg_out* w, wenv* e);
 
-wval* builtin_cmp(wenv* e, wval* a, char* op)
+void wimg_put_val(wimg_out* w, wval* v)
 {
-	WASSERT_NUM(op, a, 2);
-	int r;
-	if (strcmp(op, "==") == 0) { r =  wval_eq(a->cell[0], a->cell[1]); }
-	if (strcmp(op, "!=") == 0) { r = !wval_eq(a->cell[0], a->cell[1]); }
-	wval_del(a);
-	return wval_num(r);
+	switch (WTYPE(v))
+	{
+		case WVAL_NUM:
+			wimg_put_byte(w, 'n');
+			wimg_put_int(w, WNUM(v));
+			break;
+		case WVAL_SYM:
+			wimg_put_sym(w, WNAME(v));
+			break;
+		case WVAL_STR:
+			wimg_put_byte(w, 'x');
+			wimg_put_str(w, v->str);
+			break;
+		case WVAL_ERR:
+			wimg_put_byte(w, 'r');
+			wimg_put_str(w, v->err);
+			break;
+		case WVAL_SEXPR:
+		case WVAL_QEXPR:
+			wimg_put_byte(w, WTYPE(v) == WVAL_SEXPR ? '(' : '{');
+			wimg_put_uint(w, v->count);
+			for (int i = 0; i < v->count; i++) { wimg_put_val(w, v->cell[i]); }
+			break;
+		case WVAL_FUN:
+			if (v->builtin)
+			{
+				/* Named by the binding wenv_add_builtins gives it */
+				wenv* b = w->builtins;
+				for (int i = 0; i < b->cap; i++)
+				{
+					if (b->binds[i].sym && b->binds[i].sym != WENV_TOMB &&
+						b->binds[i].val->builtin == v->builtin)
+					{
+						wimg_put_byte(w, 'b');
+						wimg_put_sym(w, b->binds[i].sym);
+						return;
+					}
+				}
+				wimg_put_byte(w, 'z');
+				break;
+			}
+			wimg_put_byte(w, 'f');
+			wimg_put_env(w, v->env);
+			wimg_put_val(w, v->formals);
+			wimg_put_val(w, v->body);
+			if (v->args) { wimg_put_val(w, v->args); }
+			else { wimg_put_byte(w, 'z'); }
+			break;
+	}
 }
 
-wval* builtin_eq(wenv* e, wval* a) { return builtin_cmp(e, a, "=="); }
-wval* builtin_ne(wenv* e, wval* a) { return builtin_cmp(e, a, "!="); }
-
-wval* builtin_if(wenv* e, wval* a)
+void wimg_put_env(wimg_out* w, wenv* e)
 {
-	WASSERT_NUM("if",  a, 3);
-	WASSERT_TYPE("if", a, 0, WVAL_NUM);
-	WASSERT_TYPE("if", a, 1, WVAL_QEXPR);
-	WASSERT_TYPE("if", a, 2, WVAL_QEXPR);
+	if (!e)
+	{
+		wimg_put_byte(w, 'z');
+		return;
+	}
 
-	wval* x;
-	a->cell[1]->type = WVAL_SEXPR;
-	a->cell[2]->type = WVAL_SEXPR;
+	long id = wimg_id(w, e);
+	if (id >= 0)
+	{
+		wimg_put_byte(w, 'e');
+		wimg_put_uint(w, id);
+		return;
+	}
 
-	if (a->cell[0]->num) {
-		x = wval_eval(e, wval_pop(a, 1));
-	} else {
-		x = wval_eval(e, wval_pop(a, 2));
+	wimg_put_byte(w, 'E');
+	wimg_put_env(w, e->par);
+	wimg_put_uint(w, e->count);
+	for (int i = 0; i < e->cap; i++)
+	{
+		char* sym = e->binds[i].sym;
+		if (!sym || sym == WENV_TOMB) { continue; }
+		wimg_put_sym(w, sym);
+		wimg_put_val(w, e->binds[i].val);
 	}
-	
-	wval_del(a);
-	return x;
 }
 
-wval* wval_read(mpc_ast_t* t);
-
-wval* builtin_load(wenv* e, wval* a)
+/* Writes e, with everything reachable from it, to the image at path */
+int wimg_save(wenv* e, char* path)
 {
-	WASSERT_NUM("load", a, 1);
-	WASSERT_TYPE("load", a, 0, WVAL_STR);
+	wimg_out w = { NULL, 0, 0, NULL, NULL, 0, 0, wenv_new() };
+	wenv_add_builtins(w.builtins);
 
-	mpc_result_t r;
-	if (mpc_parse_contents(a->cell[0]->str, Wispy, &r))
-	{
-		wval* expr = wval_read(r.output);
-		mpc_ast_delete(r.output);
+	wimg_put(&w, WIMG_MAGIC, strlen(WIMG_MAGIC));
+	wimg_put_env(&w, e);
 
-		while (expr->count)
-		{
-			wval* x = wval_eval(e, wval_pop(expr, 0));
-			if (x->type == WVAL_ERR) { wval_println(x); }
-			wval_del(x);
-		}
+	FILE* f = fopen(path, "wb");
+	int ok = f && fwrite(w.buf, 1, w.len, f) == w.len;
+	if (f && fclose(f) != 0) { ok = 0; }
 
-		wval_del(expr);
-		wval_del(a);
-		
-		return wval_sexpr();
-	}
-	else
-	{
-		char* err_msg = mpc_err_string(r.error);
-		mpc_err_delete(r.error);
+	wenv_del(w.builtins);
+	free(w.buf);
+	free(w.keys);
+	free(w.ids);
+	return ok;
+}
 
-		wval* err = wval_err("Could not load Library %s", err_msg);
-		free(err_msg);
-		wval_del(a);
-	
-		return err;
+/* The reader's place in an image, and the symbols and envs read so far */
+typedef struct
+{
+	char* p;
+	char* end;
+	void** items;
+	char* kinds;
+	long count;
+	long cap;
+	wenv* builtins;
+	int bad;
+} wimg_in;
+
+int wimg_get_byte(wimg_in* r)
+{
+	if (r->p == r->end)
+	{
+		r->bad = 1;
+		return 0;
 	}
+	return (unsigned char)*r->p++;
 }
 
-wval* builtin_print(wenv* e, wval* a)
+unsigned long wimg_get_uint(wimg_in* r)
 {
-	for (int i = 0; i < a->count; i++) {
-		wval_print(a->cell[i]); putchar(' ');
+	unsigned long x = 0;
+	for (int shift = 0; shift < (int)sizeof(long) * 8; shift += 7)
+	{
+		int c = wimg_get_byte(r);
+		x |= (unsigned long)(c & 0x7f) << shift;
+		if (!(c & 0x80)) { return x; }
 	}
-	putchar('\n');
-	wval_del(a);
+	r->bad = 1;
+	return 0;
+}
 
-	return wval_sexpr();
+long wimg_get_int(wimg_in* r)
+{
+	unsigned long x = wimg_get_uint(r);
+	return x & 1 ? (long)~(x >> 1) : (long)(x >> 1);
 }
 
-wval* builtin_error(wenv* e, wval* a)
+/* Returns a count or length, which can never exceed the bytes left */
+long wimg_get_len(wimg_in* r)
 {
-	WASSERT_NUM("error", a, 1);
-	WASSERT_TYPE("error", a, 0, WVAL_STR);
+	unsigned long n = wimg_get_uint(r);
+	if (n > (unsigned long)(r->end - r->p))
+	{
+		r->bad = 1;
+		return 0;
+	}
+	return n;
+}
 
-	wval* err = wval_err(a->cell[0]->str);
-	
-	wval_del(a);
-	return err;
+/* Returns a fresh heap copy of the string read, or NULL */
+char* wimg_get_str(wimg_in* r)
+{
+	long n = wimg_get_len(r);
+	if (r->bad || memchr(r->p, '\0', n))
+	{
+		r->bad = 1;
+		return NULL;
+	}
+	char* s = wheap_alloc(n+1);
+	memcpy(s, r->p, n);
+	s[n] = '\0';
+	r->p += n;
+	return s;
 }
 
-void wenv_add_builtin(wenv* e, char* name, wbuiltin func)
+void wimg_add_item(wimg_in* r, void* p, char kind)
 {
-	wval* k = wval_sym(name);
-	wval* v = wval_builtin(func);
-	wenv_put(e, k, v);
-	wval_del(k);
-	wval_del(v);
+	if (r->count == r->cap)
+	{
+		r->cap = r->cap ? r->cap * 2 : 256;
+		r->items = realloc(r->items, sizeof(void*) * r->cap);
+		r->kinds = realloc(r->kinds, r->cap);
+	}
+	r->items[r->count] = p;
+	r->kinds[r->count++] = kind;
 }
 
-void wenv_add_builtins(wenv* e)
+/* Returns the interned symbol for a record with tag c, or NULL */
+char* wimg_get_sym(wimg_in* r, int c)
 {
-	/* Variable functions */
-	wenv_add_builtin(e, "def", builtin_def);
-	wenv_add_builtin(e, "=",   builtin_put);
-	wenv_add_builtin(e, "\\",  builtin_lambda);
+	if (c == 'S')
+	{
+		long n = wimg_get_len(r);
+		if (r->bad) { return NULL; }
+		char* sym = wsym_intern_n(r->p, n);
+		r->p += n;
+		wimg_add_item(r, sym, 's');
+		return sym;
+	}
 
-	/* List functions */
-	wenv_add_builtin(e, "list", builtin_list);
-	wenv_add_builtin(e, "head", builtin_head);
-	wenv_add_builtin(e, "tail", builtin_tail);
-	wenv_add_builtin(e, "eval", builtin_eval);
-	wenv_add_builtin(e, "join", builtin_join);
-	
-	/* Math functions */
-	wenv_add_builtin(e, "+", builtin_add);
-	wenv_add_builtin(e, "-", builtin_sub);
-	wenv_add_builtin(e, "*", builtin_mul);
-	wenv_add_builtin(e, "/", builtin_div);
-	
-	/* Comparison functions */
-	wenv_add_builtin(e, "if", builtin_if);
-	wenv_add_builtin(e, "==", builtin_eq);
-	wenv_add_builtin(e, "!=", builtin_ne);
-	wenv_add_builtin(e, ">",  builtin_gt);
-	wenv_add_builtin(e, "<",  builtin_lt);
-	wenv_add_builtin(e, ">=", builtin_ge);
-	wenv_add_builtin(e, "<=", builtin_le);
-	
-	/* String functions */
-	wenv_add_builtin(e, "load",  builtin_load);
-	wenv_add_builtin(e, "error", builtin_error);
-	wenv_add_builtin(e, "print", builtin_print);
+	unsigned long id = c == 's' ? wimg_get_uint(r) : 0;
+	if (c != 's' || r->bad || id >= (unsigned long)r->count || r->kinds[id] != 's')
+	{
+		r->bad = 1;
+		return NULL;
+	}
+	return r->items[id];
 }
 
-/* Evaluation */
+wenv* wimg_get_env(wimg_in* r, wenv* into);
 
-wval* wval_call(wenv* e, wval* f, wval* a)
+wval* wimg_get_val(wimg_in* r)
 {
-	if (f->builtin) { return f->builtin(e, a); }
-	
-	int given = a->count;
-	int total = f->formals->count;
+	int c = wimg_get_byte(r);
+	if (r->bad) { return wval_unit(); }
 
-	while (a->count)
+	switch (c)
 	{
-		if (f->formals->count == 0)
+		case 'n': return wval_num(wimg_get_int(r));
+		case 'S':
+		case 's':
 		{
-			wval_del(a); 
-			return wval_err(
-				"Function passed too many arguments. "
-				"Got %i, Expected %i.", given, total);
+			/* Already interned, so tagged directly */
+			char* sym = wimg_get_sym(r, c);
+			return sym ? (wval*)((uintptr_t)WSYM(sym) | 2) : wval_unit();
 		}
-		
-		wval* sym = wval_pop(f->formals, 0);
-		
-		if (strcmp(sym->sym, "&") == 0)
+		case 'x':
+		case 'r':
+		{
+			char* s = wimg_get_str(r);
+			if (!s) { return wval_unit(); }
+			wval* v = wval_alloc();
+			v->type = c == 'x' ? WVAL_STR : WVAL_ERR;
+			if (c == 'x') { v->str = s; } else { v->err = s; }
+			return v;
+		}
+		case '(':
+		case '{':
+		{
+			wval* v = c == '(' ? wval_sexpr() : wval_qexpr();
+			long n = wimg_get_len(r);
+			if (n == 0) { return v; }
+
+			wval_cells_resize(v, n);
+			for (long i = 0; i < n; i++) { v->cell[v->count++] = wimg_get_val(r); }
+			return v;
+		}
+		case 'b':
+		{
+			char* sym = wimg_get_sym(r, wimg_get_byte(r));
+			int i = sym && r->builtins ? wenv_find(r->builtins, sym) : -1;
+			if (i < 0) { break; }
+			return wval_builtin(r->builtins->binds[i].val->builtin);
+		}
+		case 'f':
 		{
-			if (f->formals->count != 1)
+			wenv* env = wimg_get_env(r, NULL);
+			wval* formals = wimg_get_val(r);
+			wval* body = wimg_get_val(r);
+			wval* args = NULL;
+			if (r->p < r->end && *r->p == 'z') { r->p++; }
+			else { args = wimg_get_val(r); }
+
+			/* Checked as builtin_lambda and wval_bind expect them */
+			int ok = env && WTYPE(formals) == WVAL_QEXPR && WTYPE(body) == WVAL_QEXPR &&
+				(!args || WTYPE(args) == WVAL_SEXPR || WTYPE(args) == WVAL_QEXPR);
+			for (int i = 0; ok && i < formals->count; i++) {
+				ok = WTYPE(formals->cell[i]) == WVAL_SYM;
+			}
+			if (!ok)
 			{
-				wval_del(a);
-				return wval_err("Function format invalid. "
-					"Symbol '&' not followed by single symbol.");
+				if (env) { wenv_del(env); }
+				wval_del(formals);
+				wval_del(body);
+				if (args) { wval_del(args); }
+				break;
 			}
-			
-			wval* nsym = wval_pop(f->formals, 0);
-			wenv_put(f->env, nsym, builtin_list(e, a));
-			wval_del(sym); wval_del(nsym);
-			break;
+
+			wval* v = wval_lambda(env, formals, body);
+			v->args = args;
+			wenv_del(env);
+			return v;
 		}
-		
-		wval* val = wval_pop(a, 0);
-		wenv_put(f->env, sym, val);
-		wval_del(sym); wval_del(val);
 	}
+	r->bad = 1;
+	return wval_unit();
+}
 
-	wval_del(a);
-	
-	if (f->formals->count > 0 &&
-		strcmp(f->formals->cell[0]->sym, "&") == 0)
+/* Returns a new reference to the env read, which is into if not NULL */
+wenv* wimg_get_env(wimg_in* r, wenv* into)
+{
+	int c = wimg_get_byte(r);
+	if (r->bad) { return NULL; }
+
+	if (c == 'z' && !into) { return NULL; }
+	if (c == 'e' && !into)
 	{
-		if (f->formals->count != 2) {
-			return wval_err("Function format invalid. "
-				"Symbol '&' not followed by single symbol.");
+		unsigned long id = wimg_get_uint(r);
+		if (r->bad || id >= (unsigned long)r->count || r->kinds[id] != 'e')
+		{
+			r->bad = 1;
+			return NULL;
 		}
-		
-		wval_del(wval_pop(f->formals, 0));
+		return wenv_share(r->items[id]);
+	}
+	if (c != 'E')
+	{
+		r->bad = 1;
+		return NULL;
+	}
 
-		wval* sym = wval_pop(f->formals, 0);
-		wval* val = wval_qexpr();
+	/* Held by the table until the whole image is read, for cycles */
+	wenv* e = into ? into : wenv_new();
+	wimg_add_item(r, wenv_share(e), 'e');
 
-		wenv_put(f->env, sym, val);
-		wval_del(sym); wval_del(val);
+	/* The root has no parent, and no env may be its own ancestor */
+	wenv* par = wimg_get_env(r, NULL);
+	for (wenv* x = par; x && !r->bad; x = x->par) {
+		if (x == e || into) { r->bad = 1; }
 	}
+	if (r->bad && par) { wenv_del(par); }
+	else { e->par = par; }
 
-	if (f->formals->count == 0) {
-		f->env->par = e;
-		return builtin_eval(
-			f->env, wval_add(wval_sexpr(), wval_copy(f->body)));
-	} else {
-		return wval_copy(f);
+	long n = wimg_get_len(r);
+	for (long i = 0; i < n && !r->bad; i++)
+	{
+		char* sym = wimg_get_sym(r, wimg_get_byte(r));
+		wval* v = wimg_get_val(r);
+		if (sym) { wenv_bind(e, sym, v); }
+		else { wval_del(v); }
 	}
+	return into ? NULL : e;
 }
 
-wval* wval_eval_sexpr(wenv* e, wval* v)
+/* Reads the image at path into e, which should have no bindings yet */
+int wimg_load(wenv* e, char* path)
 {
-	for (int i = 0; i < v->count; i++) {
-		v->cell[i] = wval_eval(e, v->cell[i]);
-	}
-	for (int i = 0; i < v->count; i++) {
-		if (v->cell[i]->type == WVAL_ERR) {
-			return wval_take(v, i);
-		}
-	}
+	wsrc f;
+	if (!wsrc_open(&f, path)) { return 0; }
 
-	if (v->count == 0) { return v; }
-	if (v->count == 1) { return wval_eval(e, wval_take(v, 0)); }
-	
-	wval* f = wval_pop(v, 0);
-	if (f->type != WVAL_FUN)
-	{
-		wval* err = wval_err(
-			"S-Expression starts with incorrect type. "
-			"Got %s, Expected %s.",
-			wtype_name(f->type), wtype_name(WVAL_FUN));
-		wval_del(f);
-		wval_del(v);
-		return err;
-	}
+	wimg_in r = { f.src, f.src + f.len, NULL, NULL, 0, 0, wenv_new(), 0 };
+	wenv_add_builtins(r.builtins);
 
-	wval* result = wval_call(e, f, v);
-	wval_del(f);
-	return result;
-}
+	size_t n = strlen(WIMG_MAGIC);
+	if (f.len < n || memcmp(f.src, WIMG_MAGIC, n) != 0) { r.bad = 1; }
+	else { r.p += n; }
 
-wval* wval_eval(wenv* e, wval* v)
-{
-	if (v->type == WVAL_SYM)
-	{
-		wval* x = wenv_get(e, v);
-		wval_del(v);
-		return x;
-	}
-	if (v->type == WVAL_SEXPR) {
-		return wval_eval_sexpr(e, v);
+	if (!r.bad) { wimg_get_env(&r, e); }
+	if (r.p != r.end) { r.bad = 1; }
+
+	for (long i = 0; i < r.count; i++) {
+		if (r.kinds[i] == 'e') { wenv_del(r.items[i]); }
 	}
-	return v;
+	wenv_del(r.builtins);
+	free(r.items);
+	free(r.kinds);
+	wsrc_close(&f);
+	return !r.bad;
 }
 
-/* Reading */
+/*
+ * load keeps the forms it reads from a file in a cache beside it, named
+ * by adding "c" to a .wisp path and ".wispc" to any other. The cache is
+ * the image encoding of the forms, headed by the length and hash of the
+ * text they were read from and a hash of the encoding itself, so it is
+ * used only for the same text and never when torn by a crashed or racing
+ * write. Under -DWISP_MPC_READER all text is read by mpc, uncached.
+ */
+
+#define WCACHE_MAGIC "wisp-cache 1\n"
 
-wval* wval_read_num(mpc_ast_t* t)
+char* wcache_path(char* path)
 {
-	errno = 0;
-	long x = strtol(t->contents, NULL, 10);
-	return errno != ERANGE ?
-		wval_num(x) : wval_err("Invalid number");
+	size_t n = strlen(path);
+	int wisp = n >= 5 && strcmp(path + n - 5, ".wisp") == 0;
+	char* cache = malloc(n + 7);
+	strcpy(cache, path);
+	strcat(cache, wisp ? "c" : ".wispc");
+	return cache;
 }
 
-wval* wval_read_str(mpc_ast_t* t)
+/* Returns the forms cached for the text in f, or NULL */
+wval* wcache_load(char* path, wsrc* f, unsigned long hash)
 {
-	t->contents[strlen(t->contents)-1] = '\0';
-	char* unescaped = malloc(strlen(t->contents+1)+1);
-	strcpy(unescaped, t->contents+1);
-	unescaped = mpcf_unescape(unescaped);
-	wval* str = wval_str(unescaped);
-	free(unescaped);
-	return str;
+#ifdef WISP_MPC_READER
+	return NULL;
+#else
+	char* cache = wcache_path(path);
+	wsrc c;
+	int opened = wsrc_open(&c, cache);
+	free(cache);
+	if (!opened) { return NULL; }
+
+	wimg_in r = { c.src, c.src + c.len, NULL, NULL, 0, 0, NULL, 0 };
+	wval* expr = NULL;
+
+	size_t n = strlen(WCACHE_MAGIC);
+	if (c.len >= n && memcmp(c.src, WCACHE_MAGIC, n) == 0)
+	{
+		r.p += n;
+		int same = wimg_get_uint(&r) == f->len && wimg_get_uint(&r) == hash;
+		unsigned long check = wimg_get_uint(&r);
+		if (same && !r.bad && whash_mem(r.p, r.end - r.p) == check)
+		{
+			expr = wimg_get_val(&r);
+			if (r.bad || r.p != r.end || WTYPE(expr) != WVAL_SEXPR)
+			{
+				wval_del(expr);
+				expr = NULL;
+			}
+		}
+	}
+
+	free(r.items);
+	free(r.kinds);
+	wsrc_close(&c);
+	return expr;
+#endif
 }
 
-wval* wval_read(mpc_ast_t* t)
+/* Writes the cache, through a temporary file so readers see all or none */
+void wcache_save(char* path, wsrc* f, unsigned long hash, wval* expr)
 {
-	if (strstr(t->tag, "number")) { return wval_read_num(t); }
-	if (strstr(t->tag, "string")) { return wval_read_str(t); }
-	if (strstr(t->tag, "symbol")) { return wval_sym(t->contents); }
+#ifndef WISP_MPC_READER
+	wimg_out w = { NULL, 0, 0, NULL, NULL, 0, 0, NULL };
+	wimg_put_val(&w, expr);
 
-	wval* x = NULL;
-	if (strcmp(t->tag, ">") == 0) { x = wval_sexpr(); }
-	if (strstr(t->tag, "sexpr"))  { x = wval_sexpr(); }
-	if (strstr(t->tag, "qexpr"))  { x = wval_qexpr(); }
+	/* Each process writes its own file, so concurrent loads never share one */
+	char* cache = wcache_path(path);
+	char* tmp = malloc(strlen(cache) + 32);
+	sprintf(tmp, "%s.%ld.tmp", cache, (long)getpid());
 
-	for (int i = 0; i < t->children_num; i++)
+	FILE* out = fopen(tmp, "wb");
+	if (out)
 	{
-		if (strcmp(t->children[i]->contents, "(") == 0) { continue; }
-		if (strcmp(t->children[i]->contents, ")") == 0) { continue; }
-		if (strcmp(t->children[i]->contents, "{") == 0) { continue; }
-		if (strcmp(t->children[i]->contents, "}") == 0) { continue; }
-		if (strcmp(t->children[i]->tag,  "regex") == 0) { continue; }
-		if (strstr(t->children[i]->tag, "comment")) { continue; }
-		x = wval_add(x, wval_read(t->children[i]));
+		fputs(WCACHE_MAGIC, out);
+
+		wimg_out h = { NULL, 0, 0, NULL, NULL, 0, 0, NULL };
+		wimg_put_uint(&h, f->len);
+		wimg_put_uint(&h, hash);
+		wimg_put_uint(&h, whash_mem(w.buf, w.len));
+		int ok = fwrite(h.buf, 1, h.len, out) == h.len &&
+			fwrite(w.buf, 1, w.len, out) == w.len;
+		free(h.buf);
+
+		if (fclose(out) != 0) { ok = 0; }
+		if (!ok || rename(tmp, cache) != 0) { remove(tmp); }
 	}
-	
-	return x;
-}
 
+	free(tmp);
+	free(cache);
+	free(w.buf);
+	free(w.keys);
+	free(w.ids);
+#endif
+}
 
 /* Custom exponentiation function */
 long power(long base, long exp)
@@ -952,33 +3934,39 @@ long power(long base, long exp)
 
 int main(int argc, char** argv)
 {
-	Number  = mpc_new("number");
-	Symbol  = mpc_new("symbol");
-	String  = mpc_new("string");
-	Comment = mpc_new("comment");
-	Sexpr   = mpc_new("sexpr");
-	Qexpr   = mpc_new("qexpr");
-	Expr    = mpc_new("expr");
-	Wispy   = mpc_new("wispy");
-
-	mpca_lang(MPCA_LANG_DEFAULT,
-		"                                                    \
-			number  : /-?[0-9]+(\\.[0-9]+)?/ ;           \
-			symbol  : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&]+/ ; \
-			string  : /\"(\\\\.|[^\"])*\"/ ;             \
-			comment : /;[^\\r\\n]*/ ;                    \
-			sexpr   : '(' <expr>* ')' ;                  \
-			qexpr   : '{' <expr>* '}' ;                  \
-			expr    : <number>  | <symbol> | <string>    \
-			        | <comment> | <sexpr>  | <qexpr> ;   \
-			wispy   : /^/ <expr>* /$/ ;                  \
-		",
-		Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Wispy);
+	wheap_init();
+	wsym_init();
+	wconst_init();
+
+	/* Options come before any files */
+	int stream = 0;
+	char* image = NULL;
+	char* save = NULL;
+	int first = 1;
+	for (; first < argc; first++)
+	{
+		if (strcmp(argv[first], "--stream") == 0) { stream = 1; }
+		else if (strcmp(argv[first], "--image") == 0 && first+1 < argc) {
+			image = argv[++first];
+		}
+		else if (strcmp(argv[first], "--save-image") == 0 && first+1 < argc) {
+			save = argv[++first];
+		}
+		else { break; }
+	}
 
-	wenv* e = wenv_new();
-	wenv_add_builtins(e);
+	/* An image holds the builtins along with everything defined after */
+	wenv* e = wenv_root = wenv_new();
+	if (!image) {
+		wenv_add_builtins(e);
+	}
+	else if (!wimg_load(e, image))
+	{
+		printf("Could not load image %s\n", image);
+		return 1;
+	}
 
-	if (argc == 1)
+	if (first == argc && !stream && !save)
 	{		
 		puts("\n Wisp Version 0.0.6");
 		puts(" A lisp-y language by Jason");
@@ -990,13 +3978,20 @@ int main(int argc, char** argv)
 			char* input = readline("wispy~> ");
 			add_history(input);
 
+			wval* x = wread_src(input);
+
 			mpc_result_t r;
-			if (mpc_parse("<stdin>", input, Wispy, &r))
+			if (!x && mpc_parse("<stdin>", input, wgrammar(), &r)) {
+				x = r.output;
+			}
+
+			if (x)
 			{
-				wval* x = wval_eval(e, wval_read(r.output));
+				warena_begin();
+				x = wval_eval(e, x);
 				wval_println(x);
 				wval_del(x);
-				mpc_ast_delete(r.output);
+				warena_end();
 			} 
 			else 
 			{
@@ -1007,22 +4002,51 @@ int main(int argc, char** argv)
 		}
 	}
 
-	if (argc >= 2)
+	if (stream)
+	{
+		/* With no files, or with "-", forms are read from standard input */
+		if (first == argc) { wval_eval_stream(e, stdin, "<stdin>"); }
+		for (int i = first; i < argc; i++)
+		{
+			FILE* f = strcmp(argv[i], "-") ? fopen(argv[i], "rb") : stdin;
+			if (!f)
+			{
+				wval* err = wval_err("Could not open %s", argv[i]);
+				wval_println(err);
+				wval_del(err);
+				continue;
+			}
+			wval_eval_stream(e, f, f == stdin ? "<stdin>" : argv[i]);
+			if (f != stdin) { fclose(f); }
+		}
+	}
+	else
 	{
-		for (int i = 1; i < argc; i++)
+		for (int i = first; i < argc; i++)
 		{
 			wval* args = wval_add(wval_sexpr(), wval_str(argv[i]));
 			wval* x = builtin_load(e, args);
-			if (x->type == WVAL_ERR) { wval_println(x); }
+			if (WTYPE(x) == WVAL_ERR) { wval_println(x); }
 			wval_del(x);
 		}
 	}
 
+	int status = 0;
+	if (save && !wimg_save(e, save))
+	{
+		printf("Could not save image %s\n", save);
+		status = 1;
+	}
+
 	wenv_del(e);
+	wgc_collect();
+	warena_cleanup();
+	wnursery_cleanup();
+	wslab_cleanup();
+	wvm_cleanup();
 
-	mpc_cleanup(8,
-		Number, Symbol, String, Comment, 
-		Sexpr,  Qexpr,  Expr,   Wispy);
+	wgrammar_cleanup();
+	wsym_cleanup();
 
-	return 0;
+	return status;
 }